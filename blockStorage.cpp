@@ -0,0 +1,246 @@
+#include "blockStorage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Builds without -mf16c still use the F16C half decode where the CPU has it, picked at run time
+// The dispatched path is built from SSE2 intrinsics, so 32-bit targets without SSE2 only get the scalar decode
+#if !defined(__F16C__) && defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define BLOCKSTORAGE_F16C_DISPATCH
+#endif
+
+using namespace std;
+
+static const char* modeNames[] = {"auto", "float32", "int16", "fp16"};
+
+const char* storageModeName(StorageMode mode) {
+    return mode <= STORAGE_FP16 ? modeNames[mode] : "?";
+}
+
+bool storageModeFromName(const char* name, StorageMode& mode) {
+    for (int i = STORAGE_AUTO; i <= STORAGE_FP16; ++i) {
+        if (strcmp(name, modeNames[i]) == 0) {
+            mode = (StorageMode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t bitsOf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float floatOf(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// IEEE half precision with round to nearest even
+uint16_t halfFromFloat(float value) {
+    uint32_t x = bitsOf(value);
+    uint16_t sign = (x >> 16) & 0x8000;
+    x &= 0x7fffffff;
+
+    if (x >= 0x7f800000) {
+        return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0);   // inf or nan
+    }
+    if (x >= 0x477ff000) {
+        return sign | 0x7c00;                                   // rounds past 65504
+    }
+    if (x < 0x38800000) {
+        // Subnormal half, the scaling by 2^24 is exact so rounding happens only once
+        return sign | (uint16_t)nearbyintf(floatOf(x) * 16777216.0f);
+    }
+
+    uint32_t h = (((x >> 23) - 112) << 10) | ((x >> 13) & 0x3ff);
+    uint32_t rem = x & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) {
+        h++;    // a carry into the exponent is still the correctly rounded result
+    }
+    return sign | (uint16_t)h;
+}
+
+float floatFromHalf(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exp = (half >> 10) & 0x1f;
+    uint32_t mant = half & 0x3ff;
+
+    if (exp == 0) {
+        float value = (float)mant / 16777216.0f;
+        return sign ? -value : value;
+    }
+    if (exp == 31) {
+        return floatOf(sign | 0x7f800000 | (mant << 13));
+    }
+    return floatOf(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+#if defined(BLOCKSTORAGE_F16C_DISPATCH)
+static bool cpuHasF16c() {
+    static const bool has = (__builtin_cpu_init(), __builtin_cpu_supports("f16c"));
+    return has;
+}
+
+// Converts whole groups of 8 and returns how many samples it did
+__attribute__((target("avx,f16c"))) static size_t decodeHalfF16c(const uint16_t* h, size_t n, float* out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i))));
+    }
+    return i;
+}
+#endif
+
+// Try the lossless int16 form: integer samples spanning at most 65535 counts
+static bool encodeInt16Exact(const float* samples, BlockHeader& header, uint16_t* narrow) {
+    float minValue = samples[0];
+    float maxValue = samples[0];
+    for (size_t i = 0; i < HISTORY_BLOCK_SIZE; ++i) {
+        float v = samples[i];
+        // -0.0f would come back as +0.0f
+        if (!(fabsf(v) < 16777216.0f) || v != nearbyintf(v) || (v == 0.0f && std::signbit(v))) {
+            return false;
+        }
+        minValue = std::min(minValue, v);
+        maxValue = std::max(maxValue, v);
+    }
+    if (maxValue - minValue > 65535.0f) {
+        return false;
+    }
+
+    header.encoding = STORAGE_INT16;
+    header.offset = minValue + 32768.0f;
+    header.scale = 1.0f;
+    for (size_t i = 0; i < HISTORY_BLOCK_SIZE; ++i) {
+        narrow[i] = (uint16_t)(int16_t)(samples[i] - header.offset);
+    }
+    return true;
+}
+
+// Lossy int16 form: the block range is spread over the 16-bit code space
+static void encodeInt16Scaled(const float* samples, BlockHeader& header, uint16_t* narrow) {
+    float minValue = std::numeric_limits<float>::max();
+    float maxValue = std::numeric_limits<float>::lowest();
+    for (size_t i = 0; i < HISTORY_BLOCK_SIZE; ++i) {
+        if (std::isfinite(samples[i])) {
+            minValue = std::min(minValue, samples[i]);
+            maxValue = std::max(maxValue, samples[i]);
+        }
+    }
+    if (minValue > maxValue) {
+        minValue = maxValue = 0.0f;
+    }
+
+    float range = maxValue - minValue;
+    header.encoding = STORAGE_INT16;
+    header.scale = range > 0.0f ? range / 65535.0f : 1.0f;
+    header.offset = minValue + 32768.0f * header.scale;
+    for (size_t i = 0; i < HISTORY_BLOCK_SIZE; ++i) {
+        float q = std::isfinite(samples[i]) ? nearbyintf((samples[i] - header.offset) / header.scale) : 0.0f;
+        narrow[i] = (uint16_t)(int16_t)std::min(32767.0f, std::max(-32768.0f, q));
+    }
+}
+
+static void encodeFp16(const float* samples, BlockHeader& header, uint16_t* narrow) {
+    header.encoding = STORAGE_FP16;
+    header.offset = 0.0f;
+    header.scale = 1.0f;
+    for (size_t i = 0; i < HISTORY_BLOCK_SIZE; ++i) {
+        narrow[i] = halfFromFloat(samples[i]);
+    }
+}
+
+static bool fitsFp16(const float* samples) {
+    for (size_t i = 0; i < HISTORY_BLOCK_SIZE; ++i) {
+        if (bitsOf(floatFromHalf(halfFromFloat(samples[i]))) != bitsOf(samples[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint8_t encodeBlock(const float* samples, StorageMode mode, BlockHeader& header, uint16_t* narrow) {
+    switch (mode) {
+    case STORAGE_INT16:
+        if (!encodeInt16Exact(samples, header, narrow)) {
+            encodeInt16Scaled(samples, header, narrow);
+        }
+        break;
+    case STORAGE_FP16:
+        encodeFp16(samples, header, narrow);
+        break;
+    case STORAGE_AUTO:
+        // Never lose information: fall back to wider encodings when a narrower one is inexact
+        if (encodeInt16Exact(samples, header, narrow)) {
+            break;
+        }
+        if (fitsFp16(samples)) {
+            encodeFp16(samples, header, narrow);
+            break;
+        }
+        // fall through
+    case STORAGE_FLOAT32:
+    default:
+        header.encoding = STORAGE_FLOAT32;
+        header.offset = 0.0f;
+        header.scale = 1.0f;
+        break;
+    }
+    return header.encoding;
+}
+
+void decodeBlock(const BlockHeader& header, const uint16_t* narrow, const float* wide, size_t first, size_t n, float* out) {
+    size_t i = 0;
+
+    switch (header.encoding) {
+    case STORAGE_FLOAT32:
+        memcpy(out, wide + first, n * sizeof(float));
+        break;
+
+    case STORAGE_INT16: {
+        const int16_t* q = reinterpret_cast<const int16_t*>(narrow) + first;
+#if defined(__SSE2__)
+        __m128 offset = _mm_set1_ps(header.offset);
+        __m128 scale = _mm_set1_ps(header.scale);
+        for (; i + 8 <= n; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(q + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);   // sign extend to 32 bit
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(out + i, _mm_add_ps(offset, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale)));
+            _mm_storeu_ps(out + i + 4, _mm_add_ps(offset, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale)));
+        }
+#endif
+        for (; i < n; ++i) {
+            out[i] = header.offset + header.scale * (float)q[i];
+        }
+        break;
+    }
+
+    case STORAGE_FP16: {
+        const uint16_t* h = narrow + first;
+#if defined(__F16C__)
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i))));
+        }
+#elif defined(BLOCKSTORAGE_F16C_DISPATCH)
+        if (cpuHasF16c()) {
+            i = decodeHalfF16c(h, n, out);
+        }
+#endif
+        for (; i < n; ++i) {
+            out[i] = floatFromHalf(h[i]);
+        }
+        break;
+    }
+    }
+}
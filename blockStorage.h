@@ -0,0 +1,43 @@
+#ifndef BLOCKSTORAGE_H
+#define BLOCKSTORAGE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Number of samples sealed together into one encoded block
+#define HISTORY_BLOCK_SIZE 256
+
+// How a channel stores its sealed blocks
+enum StorageMode : uint8_t {
+    STORAGE_AUTO,       // int16 when the block is exactly representable, then fp16, else float32
+    STORAGE_FLOAT32,    // 4 bytes per sample, lossless
+    STORAGE_INT16,      // 2 bytes per sample with a per-block offset and scale, exact for integer sources
+    STORAGE_FP16        // 2 bytes per sample, IEEE half precision
+};
+
+// Describes how one sealed block of HISTORY_BLOCK_SIZE samples is stored.
+// 16-bit encodings keep their payload in a narrow (uint16_t) slot, float32 in a wide (float) slot.
+struct BlockHeader {
+    uint8_t encoding;   // STORAGE_FLOAT32, STORAGE_INT16 or STORAGE_FP16, never STORAGE_AUTO
+    float offset;       // int16: value = offset + scale * q
+    float scale;
+
+    BlockHeader() : encoding(STORAGE_INT16), offset(0.0f), scale(1.0f) {}
+};
+
+// "auto", "float32", "int16" or "fp16"
+const char* storageModeName(StorageMode mode);
+bool storageModeFromName(const char* name, StorageMode& mode);
+
+uint16_t halfFromFloat(float value);
+float floatFromHalf(uint16_t half);
+
+// Encode HISTORY_BLOCK_SIZE samples according to mode and return the encoding picked.
+// When that is STORAGE_FLOAT32 nothing is written, the caller keeps the raw samples in a wide slot.
+uint8_t encodeBlock(const float* samples, StorageMode mode, BlockHeader& header, uint16_t* narrow);
+
+// Decode n samples starting at index first of the block into out.
+// Only the slot matching header.encoding is read, the other one may be null.
+void decodeBlock(const BlockHeader& header, const uint16_t* narrow, const float* wide, size_t first, size_t n, float* out);
+
+#endif // BLOCKSTORAGE_H
@@ -0,0 +1,361 @@
+#include "coldStore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+// MSB first bit stream over a byte vector
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out), acc_(0), bits_(0) {}
+
+    void write(uint64_t value, unsigned bits) {
+        while (bits > 0) {
+            unsigned take = std::min(bits, 56u - bits_);
+            uint64_t chunk = (value >> (bits - take)) & ((1ULL << take) - 1);
+            acc_ = (acc_ << take) | chunk;
+            bits_ += take;
+            bits -= take;
+            while (bits_ >= 8) {
+                bits_ -= 8;
+                out_.push_back((uint8_t)(acc_ >> bits_));
+            }
+        }
+    }
+
+    void flush() {
+        if (bits_ > 0) {
+            out_.push_back((uint8_t)(acc_ << (8 - bits_)));
+            bits_ = 0;
+        }
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    uint64_t acc_;
+    unsigned bits_;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data_(data), size_(size), pos_(0), acc_(0), bits_(0) {}
+
+    uint64_t read(unsigned bits) {
+        if (bits > 32) {
+            uint64_t high = read(bits - 32);
+            return (high << 32) | read(32);
+        }
+        // Keep at least 32 bits buffered, reading past the end yields zeros
+        while (bits_ <= 56) {
+            acc_ |= (uint64_t)(pos_ < size_ ? data_[pos_] : 0) << (56 - bits_);
+            pos_++;
+            bits_ += 8;
+        }
+        uint64_t value = bits ? acc_ >> (64 - bits) : 0;
+        acc_ = bits < 64 ? acc_ << bits : 0;
+        bits_ -= bits;
+        return value;
+    }
+
+    bool bit() { return read(1) != 0; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_;
+    uint64_t acc_;      // left aligned, the next bit is the MSB
+    unsigned bits_;
+};
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static unsigned bitWidth(uint64_t value) {
+    unsigned bits = 0;
+    while (value) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+
+// Delta-of-delta timestamps with Gorilla's variable size buckets
+static void writeTimes(BitWriter& out, const uint64_t* times, size_t n) {
+    out.write(times[0], 64);
+    int64_t prevDelta = 0;
+    for (size_t i = 1; i < n; ++i) {
+        int64_t delta = (int64_t)(times[i] - times[i - 1]);
+        uint64_t dod = zigzag(delta - prevDelta);
+        prevDelta = delta;
+
+        if (dod == 0) {
+            out.write(0, 1);
+        } else if (dod < (1u << 7)) {
+            out.write(0x2, 2);
+            out.write(dod, 7);
+        } else if (dod < (1u << 9)) {
+            out.write(0x6, 3);
+            out.write(dod, 9);
+        } else if (dod < (1u << 12)) {
+            out.write(0xe, 4);
+            out.write(dod, 12);
+        } else if (dod < (1ULL << 32)) {
+            out.write(0x1e, 5);
+            out.write(dod, 32);
+        } else {
+            out.write(0x1f, 5);
+            out.write(dod, 64);
+        }
+    }
+}
+
+static void readTimes(BitReader& in, uint64_t* times, size_t n) {
+    uint64_t time = in.read(64);
+    int64_t delta = 0;
+    if (times) {
+        times[0] = time;
+    }
+    for (size_t i = 1; i < n; ++i) {
+        uint64_t dod = 0;
+        if (in.bit()) {
+            if (!in.bit()) {
+                dod = in.read(7);
+            } else if (!in.bit()) {
+                dod = in.read(9);
+            } else if (!in.bit()) {
+                dod = in.read(12);
+            } else {
+                dod = in.read(in.bit() ? 64 : 32);
+            }
+        }
+        delta += unzigzag(dod);
+        time += delta;
+        if (times) {
+            times[i] = time;
+        }
+    }
+}
+
+static uint32_t bitsOf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float floatOf(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static unsigned leadingZeros(uint32_t value) {
+    unsigned count = 0;
+    for (uint32_t mask = 0x80000000u; mask && !(value & mask); mask >>= 1) {
+        count++;
+    }
+    return count;
+}
+
+static unsigned trailingZeros(uint32_t value) {
+    unsigned count = 0;
+    for (uint32_t mask = 1; mask && !(value & mask); mask <<= 1) {
+        count++;
+    }
+    return count;
+}
+
+// Gorilla XOR compression adapted to 32-bit floats
+static void writeXor(BitWriter& out, const float* values, size_t n) {
+    uint32_t prev = bitsOf(values[0]);
+    out.write(prev, 32);
+
+    unsigned prevLeading = 33;
+    unsigned prevTrailing = 0;
+    for (size_t i = 1; i < n; ++i) {
+        uint32_t cur = bitsOf(values[i]);
+        uint32_t x = cur ^ prev;
+        prev = cur;
+
+        if (x == 0) {
+            out.write(0, 1);
+            continue;
+        }
+
+        unsigned leading = std::min(leadingZeros(x), 31u);
+        unsigned trailing = trailingZeros(x);
+        if (prevLeading <= 32 && leading >= prevLeading && trailing >= prevTrailing) {
+            // Meaningful bits fit in the previous window
+            out.write(0x2, 2);
+            out.write(x >> prevTrailing, 32 - prevLeading - prevTrailing);
+        } else {
+            unsigned length = 32 - leading - trailing;
+            out.write(0x3, 2);
+            out.write(leading, 5);
+            out.write(length - 1, 5);
+            out.write(x >> trailing, length);
+            prevLeading = leading;
+            prevTrailing = trailing;
+        }
+    }
+}
+
+static void readXor(BitReader& in, float* values, size_t n) {
+    uint32_t prev = (uint32_t)in.read(32);
+    values[0] = floatOf(prev);
+
+    unsigned leading = 0;
+    unsigned trailing = 0;
+    for (size_t i = 1; i < n; ++i) {
+        if (in.bit()) {
+            if (in.bit()) {
+                leading = (unsigned)in.read(5);
+                unsigned length = (unsigned)in.read(5) + 1;
+                trailing = 32 - leading - length;
+            }
+            prev ^= (uint32_t)in.read(32 - leading - trailing) << trailing;
+        }
+        values[i] = floatOf(prev);
+    }
+}
+
+// Integer samples: first value, then zigzagged deltas packed at the widest delta's width
+static bool isIntegral(const float* values, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        // -0.0f would come back as +0.0f, such blocks go through the bit exact XOR path
+        if (!(fabsf(values[i]) < 2147483648.0f) || values[i] != nearbyintf(values[i]) ||
+            (values[i] == 0.0f && std::signbit(values[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void writeDelta(BitWriter& out, const float* values, size_t n) {
+    unsigned width = 0;
+    for (size_t i = 1; i < n; ++i) {
+        width = std::max(width, bitWidth(zigzag((int64_t)values[i] - (int64_t)values[i - 1])));
+    }
+
+    out.write(zigzag((int64_t)values[0]), 33);
+    out.write(width, 6);
+    for (size_t i = 1; i < n && width > 0; ++i) {
+        out.write(zigzag((int64_t)values[i] - (int64_t)values[i - 1]), width);
+    }
+}
+
+static void readDelta(BitReader& in, float* values, size_t n) {
+    int64_t value = unzigzag(in.read(33));
+    unsigned width = (unsigned)in.read(6);
+    values[0] = (float)value;
+    for (size_t i = 1; i < n; ++i) {
+        if (width > 0) {
+            value += unzigzag(in.read(width));
+        }
+        values[i] = (float)value;
+    }
+}
+
+void encodeColdBlock(const float* values, const uint64_t* times, size_t n, uint64_t firstSeq, ColdBlock& block) {
+    block.firstSeq = firstSeq;
+    block.firstTime = times[0];
+    block.lastTime = times[n - 1];
+    block.count = (uint16_t)n;
+    block.minValue = std::numeric_limits<float>::max();
+    block.maxValue = std::numeric_limits<float>::lowest();
+    for (size_t i = 0; i < n; ++i) {
+        block.minValue = std::min(block.minValue, values[i]);
+        block.maxValue = std::max(block.maxValue, values[i]);
+    }
+
+    block.bytes.clear();
+    BitWriter out(block.bytes);
+    writeTimes(out, times, n);
+    if (isIntegral(values, n)) {
+        block.encoding = COLD_DELTA;
+        writeDelta(out, values, n);
+    } else {
+        block.encoding = COLD_XOR;
+        writeXor(out, values, n);
+    }
+    out.flush();
+    block.bytes.shrink_to_fit();
+}
+
+void decodeColdBlock(const ColdBlock& block, float* values, uint64_t* times) {
+    BitReader in(block.bytes.data(), block.bytes.size());
+    readTimes(in, times, block.count);
+    if (!values) {
+        return;
+    }
+    if (block.encoding == COLD_DELTA) {
+        readDelta(in, values, block.count);
+    } else {
+        readXor(in, values, block.count);
+    }
+}
+
+ColdStore::ColdStore(size_t budgetBytes)
+    : blocks_(0), nextSeq_(0), compressedBytes_(0), samples_(0), budgetBytes_(budgetBytes) {
+    for (auto& segment : segments_) {
+        segment.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ColdStore::~ColdStore() {
+    for (auto& segment : segments_) {
+        delete[] segment.load();
+    }
+}
+
+bool ColdStore::append(const float* values, const uint64_t* times, size_t n, uint64_t firstSeq) {
+    size_t index = blocks_.load(std::memory_order_relaxed);
+    size_t segment = index / COLD_SEGMENT_BLOCKS;
+    if (segment >= COLD_MAX_SEGMENTS || n == 0 || compressedBytes() >= budgetBytes_) {
+        return false;
+    }
+
+    ColdBlock* blocks = segments_[segment].load(std::memory_order_relaxed);
+    if (!blocks) {
+        blocks = new ColdBlock[COLD_SEGMENT_BLOCKS];
+        segments_[segment].store(blocks, std::memory_order_release);
+    }
+
+    ColdBlock& block = blocks[index % COLD_SEGMENT_BLOCKS];
+    encodeColdBlock(values, times, n, firstSeq, block);
+
+    compressedBytes_.fetch_add(sizeof(ColdBlock) + block.bytes.size(), std::memory_order_relaxed);
+    samples_.fetch_add(n, std::memory_order_relaxed);
+
+    // Sized for a full archive, so it always has room when the directory does
+    summaries_.append(values, n, firstSeq);
+
+    nextSeq_.store(firstSeq + n, std::memory_order_release);
+    blocks_.store(index + 1, std::memory_order_release);
+    return true;
+}
+
+size_t ColdStore::find(uint64_t seq) const {
+    size_t count = size();
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (block(mid).firstSeq + block(mid).count <= seq) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < count && block(lo).firstSeq <= seq) {
+        return lo;
+    }
+    return count;
+}
@@ -0,0 +1,88 @@
+#ifndef COLDSTORE_H
+#define COLDSTORE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "blockStorage.h"
+#include "rangeIndex.h"
+
+// Blocks per directory segment and number of segments, bounding one channel's archive
+#define COLD_SEGMENT_BLOCKS 4096
+#define COLD_MAX_SEGMENTS 4096
+
+// Default RAM one channel's archive may take, as counted by compressedBytes()
+#define COLD_BUDGET_BYTES (64u << 20)
+
+// How the values of a cold block are compressed
+enum ColdEncoding : uint8_t {
+    COLD_XOR,       // Gorilla style XOR against the previous float
+    COLD_DELTA      // integer samples: delta, zigzag and fixed width bitpacking
+};
+
+// One compressed block of up to HISTORY_BLOCK_SIZE samples. The header is enough for
+// overview rendering and autoscaling, only the payload needs decompressing.
+struct ColdBlock {
+    uint64_t firstSeq;              // sequence number of the first sample
+    uint64_t firstTime;             // timestamps in microseconds
+    uint64_t lastTime;
+    float minValue;
+    float maxValue;
+    uint16_t count;
+    uint8_t encoding;
+    std::vector<uint8_t> bytes;     // delta-of-delta timestamps followed by the values
+};
+
+// Compress n samples with their timestamps into block
+void encodeColdBlock(const float* values, const uint64_t* times, size_t n, uint64_t firstSeq, ColdBlock& block);
+
+// Decompress a block, either output may be null when not needed
+void decodeColdBlock(const ColdBlock& block, float* values, uint64_t* times);
+
+// Append only archive of one channel's sealed blocks.
+// A single writer appends, any number of readers may look at the blocks already published.
+class ColdStore {
+public:
+    explicit ColdStore(size_t budgetBytes = COLD_BUDGET_BYTES);
+    ~ColdStore();
+
+    ColdStore(const ColdStore&) = delete;
+    ColdStore& operator=(const ColdStore&) = delete;
+
+    // Compress and publish a block. Returns false once the archive is full, either because the
+    // directory ran out of segments or because compressedBytes() reached the budget. Published
+    // blocks are never evicted, so the budget may be overshot by the last block appended.
+    bool append(const float* values, const uint64_t* times, size_t n, uint64_t firstSeq);
+
+    // Number of published blocks and the sequence number following the last of them
+    size_t size() const { return blocks_.load(std::memory_order_acquire); }
+    uint64_t nextSeq() const { return nextSeq_.load(std::memory_order_acquire); }
+
+    const ColdBlock& block(size_t index) const {
+        return segments_[index / COLD_SEGMENT_BLOCKS].load(std::memory_order_acquire)[index % COLD_SEGMENT_BLOCKS];
+    }
+
+    // Compressed bytes and raw samples held, for reporting the compression ratio
+    size_t compressedBytes() const { return compressedBytes_.load(std::memory_order_relaxed); }
+    uint64_t samples() const { return samples_.load(std::memory_order_relaxed); }
+    size_t budgetBytes() const { return budgetBytes_; }
+
+    // Index of the block holding sequence number seq, or size() if it is not archived
+    size_t find(uint64_t seq) const;
+
+    // Exact aggregate of the blocks [first, last), O(log size())
+    RangeSummary summarize(size_t first, size_t last) const { return summaries_.query(first, last); }
+
+private:
+    std::atomic<ColdBlock*> segments_[COLD_MAX_SEGMENTS];
+    std::atomic<size_t> blocks_;
+    std::atomic<uint64_t> nextSeq_;
+    std::atomic<size_t> compressedBytes_;
+    std::atomic<uint64_t> samples_;
+    size_t budgetBytes_;
+    RangeIndex summaries_;          // one leaf per block, written before the block is published
+};
+
+#endif // COLDSTORE_H
@@ -0,0 +1,697 @@
+#include "history.h"
+#include "trace.h"
+#include "overload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+#define MAX_READERS 64
+
+enum { WRITER_FREE, WRITER_INGEST, WRITER_RESIZER };
+
+// Published table and a resized table waiting to be adopted by the writer
+static std::atomic<HistoryTable*> current(nullptr);
+static std::atomic<HistoryTable*> pending(nullptr);
+
+// Whoever owns this token may push samples and swap tables
+static std::atomic<int> writerOwner(WRITER_FREE);
+
+// Epoch based reclamation: a reader publishes the epoch it entered in, 0 means quiescent
+static std::atomic<uint64_t> globalEpoch(1);
+static std::atomic<uint64_t> readerEpochs[MAX_READERS];
+static std::atomic<bool> readerClaimed[MAX_READERS];
+static thread_local int readerDepth = 0;
+
+// A thread's slot in readerEpochs, handed back when the thread exits so short lived readers never run out
+struct ReaderSlot {
+    size_t index = MAX_READERS;
+
+    ~ReaderSlot() {
+        if (index != MAX_READERS) {
+            readerEpochs[index].store(0);
+            readerClaimed[index].store(false, std::memory_order_release);
+        }
+    }
+};
+static thread_local ReaderSlot readerSlot;
+
+// Tables that are unpublished but may still be in use by a reader
+static std::atomic<HistoryTable*> retired(nullptr);
+
+static std::thread resizer;
+static std::mutex resizeMutex;
+static std::condition_variable resizeCond;
+static std::atomic<size_t> requestedCapacity(0);
+static std::atomic<bool> resizerRunning(false);
+
+// Per channel StorageMode, zero initialised to STORAGE_AUTO
+static std::atomic<uint8_t> storageModes[HISTORY_MAX_CHANNELS];
+
+// Per channel compressed archive, created by the writer when the channel first goes live
+static std::atomic<ColdStore*> archives[HISTORY_MAX_CHANNELS];
+
+ChannelRing::ChannelRing(size_t capacity, size_t channel)
+    : window(capacity), channel(channel), narrow(nullptr), wide(nullptr), written(0), archive(nullptr) {
+    // One spare block so the window is always covered while the newest block is still open
+    size_t blocks = (capacity + HISTORY_BLOCK_SIZE - 1) / HISTORY_BLOCK_SIZE + 1;
+    headers.resize(blocks);
+
+    // Only the payload kind the current mode needs is allocated up front, AUTO waits for the
+    // first sealed block so a float source never pays for a narrow payload
+    switch (historyStorage(channel)) {
+    case STORAGE_FLOAT32:
+        wide = new float[blocks * HISTORY_BLOCK_SIZE]();
+        for (auto& header : headers) {
+            header.encoding = STORAGE_FLOAT32;
+        }
+        break;
+    case STORAGE_INT16:
+    case STORAGE_FP16:
+        narrow = new uint16_t[blocks * HISTORY_BLOCK_SIZE]();
+        break;
+    default:
+        break;
+    }
+    memset(open, 0, sizeof(open));
+    memset(openTimes, 0, sizeof(openTimes));
+}
+
+ChannelRing::~ChannelRing() {
+    delete[] narrow.load();
+    delete[] wide.load();
+}
+
+void ChannelRing::decodeSlot(size_t slot, size_t first, size_t n, float* out) const {
+    const uint16_t* narrowSlot = narrow.load(std::memory_order_acquire);
+    const float* wideSlot = wide.load(std::memory_order_acquire);
+    if (narrowSlot) {
+        narrowSlot += slot * HISTORY_BLOCK_SIZE;
+    }
+    if (wideSlot) {
+        wideSlot += slot * HISTORY_BLOCK_SIZE;
+    }
+
+    // A slot never sealed in a ring that has not allocated its payload yet reads as zero
+    const BlockHeader& header = headers[slot];
+    if (!(header.encoding == STORAGE_FLOAT32 ? (const void*)wideSlot : (const void*)narrowSlot)) {
+        memset(out, 0, n * sizeof(float));
+        return;
+    }
+    decodeBlock(header, narrowSlot, wideSlot, first, n, out);
+}
+
+float ChannelRing::at(uint64_t seq) const {
+    float value;
+    read(seq, 1, &value);
+    return value;
+}
+
+void ChannelRing::read(uint64_t seq, size_t n, float* out) const {
+    uint64_t openBlock = written.load(std::memory_order_acquire) / HISTORY_BLOCK_SIZE;
+
+    while (n > 0) {
+        uint64_t block = seq / HISTORY_BLOCK_SIZE;
+        size_t first = seq % HISTORY_BLOCK_SIZE;
+        size_t chunk = std::min<size_t>(n, HISTORY_BLOCK_SIZE - first);
+
+        bool sealed = block < openBlock;
+        if (!sealed) {
+            memcpy(out, open[block & 1] + first, chunk * sizeof(float));
+
+            // If the writer started reusing this half of the double buffer meanwhile,
+            // the block has been sealed by now and can be read from its slot instead
+            std::atomic_thread_fence(std::memory_order_acquire);
+            sealed = written.load(std::memory_order_relaxed) / HISTORY_BLOCK_SIZE >= block + 2;
+        }
+        if (sealed) {
+            decodeSlot(block % headers.size(), first, chunk, out);
+        }
+
+        seq += chunk;
+        out += chunk;
+        n -= chunk;
+    }
+}
+
+void ChannelRing::readWindow(uint64_t end, size_t first, size_t n, float* out) const {
+    uint64_t missing = end < window ? window - end : 0;
+    while (n > 0 && first < missing) {
+        *out++ = 0.0f;
+        ++first;
+        --n;
+    }
+    if (n > 0) {
+        read(end - window + first, n, out);
+    }
+}
+
+RangeSummary ChannelRing::summarize(uint64_t first, uint64_t last) const {
+    RangeSummary summary;
+    float samples[HISTORY_BLOCK_SIZE];
+
+    last = std::min(last, count());
+    while (first < last) {
+        size_t block = archive ? archive->find(first) : 0;
+        if (!archive || block == archive->size()) {
+            break;
+        }
+
+        const ColdBlock& cold = archive->block(block);
+        uint64_t blockEnd = cold.firstSeq + cold.count;
+        if (cold.firstSeq == first && blockEnd <= last) {
+            // Whole blocks up to the one holding last, answered from the summary tree
+            size_t wholeEnd = archive->find(last);
+            summary.merge(archive->summarize(block, wholeEnd));
+            const ColdBlock& lastWhole = archive->block(wholeEnd - 1);
+            first = lastWhole.firstSeq + lastWhole.count;
+        } else {
+            // Partial block at either edge
+            decodeColdBlock(cold, samples, nullptr);
+            uint64_t end = std::min(blockEnd, last);
+            summary.add(samples + (first - cold.firstSeq), (size_t)(end - first), first);
+            first = end;
+        }
+    }
+
+    // The open block, or everything the ring still holds if there is no archive
+    first = std::max(first, lostBefore(count()));
+    while (first < last) {
+        size_t n = (size_t)std::min<uint64_t>(HISTORY_BLOCK_SIZE, last - first);
+        read(first, n, samples);
+        summary.add(samples, n, first);
+        first += n;
+    }
+    return summary;
+}
+
+uint64_t ChannelRing::crossings(uint64_t first, uint64_t last, float level) const {
+    float samples[HISTORY_BLOCK_SIZE];
+    uint64_t passes = 0;
+    int side = 0;       // -1 below level, 1 at or above it, 0 before the first sample
+
+    auto scan = [&](const float* values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            int now = values[i] >= level ? 1 : -1;
+            passes += side != 0 && now != side;
+            side = now;
+        }
+    };
+
+    last = std::min(last, count());
+    while (first < last && archive) {
+        size_t block = archive->find(first);
+        if (block == archive->size()) {
+            break;
+        }
+        const ColdBlock& cold = archive->block(block);
+        decodeColdBlock(cold, samples, nullptr);
+        uint64_t end = std::min<uint64_t>(cold.firstSeq + cold.count, last);
+        scan(samples + (first - cold.firstSeq), (size_t)(end - first));
+        first = end;
+    }
+
+    first = std::max(first, lostBefore(count()));
+    while (first < last) {
+        size_t n = (size_t)std::min<uint64_t>(HISTORY_BLOCK_SIZE, last - first);
+        read(first, n, samples);
+        scan(samples, n);
+        first += n;
+    }
+    return passes;
+}
+
+uint64_t ChannelRing::timeOf(uint64_t seq) const {
+    uint64_t end = count();
+    if (seq >= end) {
+        return 0;
+    }
+
+    if (archive) {
+        size_t block = archive->find(seq);
+        if (block < archive->size()) {
+            uint64_t times[HISTORY_BLOCK_SIZE];
+            const ColdBlock& cold = archive->block(block);
+            decodeColdBlock(cold, nullptr, times);
+            return times[seq - cold.firstSeq];
+        }
+    }
+    if (seq / HISTORY_BLOCK_SIZE + 1 >= end / HISTORY_BLOCK_SIZE) {
+        return timeAt(seq);
+    }
+    return 0;
+}
+
+uint64_t ChannelRing::lostBefore(uint64_t now) const {
+    uint64_t newest = now / HISTORY_BLOCK_SIZE;
+
+    // Sealing block newest may already be reusing the slot of block newest - headers.size()
+    return newest + 1 >= headers.size() ? (newest + 1 - headers.size()) * HISTORY_BLOCK_SIZE : 0;
+}
+
+void ChannelRing::seal(uint64_t block) {
+    size_t slot = block % headers.size();
+    const float* samples = open[block & 1];
+    StorageMode mode = historyStorage(channel);
+
+    // Blocks replayed into a ring during a resize are already archived
+    if (archive && block * HISTORY_BLOCK_SIZE >= archive->nextSeq()) {
+        if (!archive->append(samples, openTimes[block & 1], HISTORY_BLOCK_SIZE, block * HISTORY_BLOCK_SIZE)) {
+            overloadCount(OVERLOAD_ARCHIVE_FULL);
+        }
+    }
+
+    // Encode into a local header, a reader must not see an encoding before its payload exists.
+    // Until a block actually needs the narrow payload the encoder works in scratch, so an AUTO
+    // ring fed float data only ever allocates the wide one.
+    BlockHeader header;
+    uint16_t scratch[HISTORY_BLOCK_SIZE];
+    uint16_t* narrowSlot = narrow.load(std::memory_order_relaxed);
+    uint8_t encoding = encodeBlock(samples, mode, header, narrowSlot ? narrowSlot + slot * HISTORY_BLOCK_SIZE : scratch);
+
+    // A payload kind needed for the first time lives as long as the ring, so readers never see it freed
+    if (encoding != STORAGE_FLOAT32 && !narrowSlot) {
+        narrowSlot = new uint16_t[headers.size() * HISTORY_BLOCK_SIZE]();
+        memcpy(narrowSlot + slot * HISTORY_BLOCK_SIZE, scratch, sizeof(scratch));
+        narrow.store(narrowSlot, std::memory_order_release);
+    }
+    if (encoding == STORAGE_FLOAT32) {
+        float* wideSlot = wide.load(std::memory_order_relaxed);
+        if (!wideSlot) {
+            wideSlot = new float[headers.size() * HISTORY_BLOCK_SIZE]();
+            wide.store(wideSlot, std::memory_order_release);
+        }
+        memcpy(wideSlot + slot * HISTORY_BLOCK_SIZE, samples, sizeof(open[0]));
+    }
+    headers[slot] = header;
+}
+
+void ChannelRing::seek(uint64_t seq) {
+    uint16_t* narrowSlot = narrow.load(std::memory_order_relaxed);
+    float* wideSlot = wide.load(std::memory_order_relaxed);
+    if (narrowSlot) {
+        memset(narrowSlot, 0, headers.size() * HISTORY_BLOCK_SIZE * sizeof(uint16_t));
+    }
+    if (wideSlot) {
+        memset(wideSlot, 0, headers.size() * HISTORY_BLOCK_SIZE * sizeof(float));
+    }
+    for (auto& header : headers) {
+        header = BlockHeader();
+        header.encoding = narrowSlot ? STORAGE_INT16 : STORAGE_FLOAT32;
+    }
+    memset(open, 0, sizeof(open));
+    memset(openTimes, 0, sizeof(openTimes));
+    written.store(seq, std::memory_order_release);
+}
+
+size_t ChannelRing::bytes() const {
+    size_t total = sizeof(*this) + headers.size() * sizeof(BlockHeader);
+    if (narrow.load(std::memory_order_relaxed)) {
+        total += headers.size() * HISTORY_BLOCK_SIZE * sizeof(uint16_t);
+    }
+    if (wide.load(std::memory_order_relaxed)) {
+        total += headers.size() * HISTORY_BLOCK_SIZE * sizeof(float);
+    }
+    return total;
+}
+
+size_t ChannelRing::sampleBytes() const {
+    size_t perSample = 0;
+    if (narrow.load(std::memory_order_relaxed)) {
+        perSample += sizeof(uint16_t);
+    }
+    if (wide.load(std::memory_order_relaxed)) {
+        perSample += sizeof(float);
+    }
+    return perSample;
+}
+
+size_t ChannelRing::recentSampleBytes() const {
+    bool narrowUsed = false;
+    bool wideUsed = false;
+    size_t sealed = (size_t)std::min<uint64_t>(count() / HISTORY_BLOCK_SIZE, headers.size());
+    for (size_t slot = 0; slot < sealed; ++slot) {
+        if (headers[slot].encoding == STORAGE_FLOAT32) {
+            wideUsed = true;
+        } else {
+            narrowUsed = true;
+        }
+    }
+
+    // Nothing sealed yet, assume the narrow encodings AUTO tries first
+    if (!narrowUsed && !wideUsed) {
+        return sizeof(uint16_t);
+    }
+    return (narrowUsed ? sizeof(uint16_t) : 0) + (wideUsed ? sizeof(float) : 0);
+}
+
+static std::atomic<uint64_t> tableGenerations(0);
+
+HistoryTable::HistoryTable(size_t capacity)
+    : capacity(capacity), generation(tableGenerations.fetch_add(1) + 1), retireEpoch(0), nextRetired(nullptr) {}
+
+HistoryTable::~HistoryTable() {
+    for (auto ring : rings) {
+        delete ring;
+    }
+}
+
+// Only MAX_READERS threads can read at once, further ones wait here until a reader thread exits
+static size_t claimReaderSlot() {
+    for (;;) {
+        for (size_t i = 0; i < MAX_READERS; ++i) {
+            bool expected = false;
+            if (!readerClaimed[i].load(std::memory_order_relaxed) && readerClaimed[i].compare_exchange_strong(expected, true)) {
+                return i;
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+HistoryReadGuard::HistoryReadGuard() {
+    if (readerSlot.index == MAX_READERS) {
+        readerSlot.index = claimReaderSlot();
+    }
+    if (readerDepth++ == 0) {
+        readerEpochs[readerSlot.index].store(globalEpoch.load());
+    }
+    table_ = current.load();
+}
+
+HistoryReadGuard::~HistoryReadGuard() {
+    if (--readerDepth == 0) {
+        readerEpochs[readerSlot.index].store(0, std::memory_order_release);
+    }
+}
+
+// Copy the samples of src with sequence number >= fromSeq into dst, oldest first.
+// The most recent samples that fit in dst survive. When dst is larger than src, the samples
+// src no longer holds are filled in from the channel's archive, so a grown window shows the
+// same data the archive based summaries and autoscaling see.
+static void migrateRing(const ChannelRing& src, ChannelRing& dst, uint64_t fromSeq) {
+    uint64_t end = src.count();
+    // The open block is always held, whatever the capacity, and not archived yet
+    uint64_t held = std::min(end - std::min<uint64_t>(src.capacity(), end), end / HISTORY_BLOCK_SIZE * HISTORY_BLOCK_SIZE);
+    const ColdStore* archive = src.archive;
+
+    // Sealed blocks reach the archive in order, so it continues seamlessly into what src holds
+    uint64_t oldest = held;
+    if (archive && archive->size() > 0 && archive->nextSeq() >= held) {
+        oldest = std::min(oldest, archive->block(0).firstSeq);
+    }
+
+    uint64_t keep = std::min<uint64_t>(dst.capacity(), end - oldest);
+    uint64_t begin = std::max(fromSeq, end - keep);
+
+    // Always carry the whole open block over, or it would be archived with a hole once sealed
+    begin = std::min(begin, std::max(fromSeq, end / HISTORY_BLOCK_SIZE * HISTORY_BLOCK_SIZE));
+
+    if (dst.count() != begin) {
+        dst.seek(begin);
+    }
+
+    float chunk[HISTORY_BLOCK_SIZE];
+    float archived[HISTORY_BLOCK_SIZE];
+    uint64_t archivedTimes[HISTORY_BLOCK_SIZE];
+    for (uint64_t seq = begin; seq < end;) {
+        // Chunks follow block boundaries, each one lies within a single archived block
+        size_t n = std::min<uint64_t>(HISTORY_BLOCK_SIZE - seq % HISTORY_BLOCK_SIZE, end - seq);
+        src.read(seq, n, chunk);
+
+        // When copying without the writer token the ingest thread may have lapped the oldest
+        // samples while we read them. Take those from the archive too, or blank them if it lacks them.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t lost = std::max(held, src.lostBefore(src.written.load(std::memory_order_relaxed)));
+
+        const ColdBlock* cold = nullptr;
+        if (seq < lost && archive) {
+            size_t block = archive->find(seq);
+            if (block < archive->size()) {
+                cold = &archive->block(block);
+                decodeColdBlock(*cold, archived, archivedTimes);
+            }
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            if (seq + i >= lost) {
+                dst.push(chunk[i], src.timeAt(seq + i));
+            } else if (cold) {
+                dst.push(archived[seq + i - cold->firstSeq], archivedTimes[seq + i - cold->firstSeq]);
+            } else {
+                dst.push(0.0f, src.timeAt(seq + i));
+            }
+        }
+        seq += n;
+    }
+}
+
+// Unpublish old and hand it over to the reclaimer. Caller holds the writer token.
+static void retire(HistoryTable* old) {
+    old->retireEpoch = globalEpoch.fetch_add(1);
+    old->nextRetired = retired.load(std::memory_order_relaxed);
+    while (!retired.compare_exchange_weak(old->nextRetired, old, std::memory_order_release)) {
+    }
+}
+
+// Free every retired table that no active reader could have observed
+static void reclaim() {
+    HistoryTable* list = retired.exchange(nullptr, std::memory_order_acquire);
+    if (!list) {
+        return;
+    }
+
+    uint64_t oldestReader = UINT64_MAX;
+    for (size_t i = 0; i < MAX_READERS; ++i) {
+        uint64_t epoch = readerEpochs[i].load();
+        if (epoch != 0) {
+            oldestReader = std::min(oldestReader, epoch);
+        }
+    }
+
+    while (list) {
+        HistoryTable* table = list;
+        list = list->nextRetired;
+        if (table->retireEpoch < oldestReader) {
+            delete table;
+        } else {
+            table->nextRetired = retired.load(std::memory_order_relaxed);
+            while (!retired.compare_exchange_weak(table->nextRetired, table, std::memory_order_release)) {
+            }
+        }
+    }
+}
+
+// Hook a ring up to its channel's archive, creating the archive on first use. Writer token only.
+static void goLive(ChannelRing& ring) {
+    if (ring.channel >= HISTORY_MAX_CHANNELS) {
+        return;
+    }
+    ColdStore* archive = archives[ring.channel].load(std::memory_order_relaxed);
+    if (!archive) {
+        archive = new ColdStore();
+        archives[ring.channel].store(archive, std::memory_order_release);
+    }
+    ring.archive = archive;
+}
+
+// Swap in the pending table, replaying whatever was pushed since it was built.
+// Caller holds the writer token, so this only races with readers.
+static void adoptPending() {
+    HistoryTable* next = pending.exchange(nullptr, std::memory_order_acquire);
+    if (!next) {
+        return;
+    }
+    TRACE_SCOPE("history adopt");
+
+    HistoryTable* cur = current.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < cur->rings.size(); ++i) {
+        if (i < next->rings.size()) {
+            goLive(*next->rings[i]);
+            migrateRing(*cur->rings[i], *next->rings[i], next->rings[i]->count());
+        } else {
+            // Channel appeared after the resizer took its snapshot
+            next->rings.push_back(new ChannelRing(next->capacity, i));
+            goLive(*next->rings.back());
+            migrateRing(*cur->rings[i], *next->rings.back(), 0);
+        }
+    }
+
+    current.store(next);
+    retire(cur);
+}
+
+static void growChannels(size_t numChannels) {
+    HistoryTable* cur = current.load(std::memory_order_relaxed);
+    if (cur->rings.size() >= numChannels) {
+        return;
+    }
+
+    HistoryTable* next = new HistoryTable(cur->capacity);
+    for (size_t i = 0; i < numChannels; ++i) {
+        next->rings.push_back(new ChannelRing(next->capacity, i));
+        goLive(*next->rings.back());
+        if (i < cur->rings.size()) {
+            migrateRing(*cur->rings[i], *next->rings[i], 0);
+        }
+    }
+
+    current.store(next);
+    retire(cur);
+}
+
+// Build a table of the given capacity from a snapshot of the published one and
+// queue it for adoption. The expensive copy happens here, off the ingest thread.
+static void rebuild(size_t capacity) {
+    TRACE_SCOPE("history rebuild");
+    HistoryTable* next = new HistoryTable(capacity);
+    {
+        HistoryReadGuard guard;
+        const HistoryTable& published = guard.table();
+        for (size_t i = 0; i < published.rings.size(); ++i) {
+            next->rings.push_back(new ChannelRing(capacity, i));
+            migrateRing(*published.rings[i], *next->rings.back(), 0);
+        }
+    }
+    pending.store(next, std::memory_order_release);
+
+    // The ingest thread adopts it on its next push. If the device is idle, do it here instead.
+    while (pending.load(std::memory_order_acquire)) {
+        int expected = WRITER_FREE;
+        if (writerOwner.compare_exchange_strong(expected, WRITER_RESIZER, std::memory_order_acquire)) {
+            adoptPending();
+            writerOwner.store(WRITER_FREE, std::memory_order_release);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+static void resizerLoop() {
+    traceSetThreadName("history resizer");
+    size_t built = requestedCapacity.load();
+
+    std::unique_lock<std::mutex> lock(resizeMutex);
+    while (resizerRunning) {
+        // Wake up periodically anyway so retired tables get freed
+        resizeCond.wait_for(lock, std::chrono::milliseconds(100), [&] {
+            return !resizerRunning || requestedCapacity.load() != built;
+        });
+
+        reclaim();
+
+        size_t capacity = requestedCapacity.load();
+        if (!resizerRunning || capacity == built) {
+            continue;
+        }
+
+        lock.unlock();
+        rebuild(capacity);
+        built = capacity;
+        lock.lock();
+    }
+}
+
+void historyInit(size_t numChannels, size_t capacity) {
+    HistoryTable* table = new HistoryTable(capacity);
+    for (size_t i = 0; i < numChannels; ++i) {
+        table->rings.push_back(new ChannelRing(capacity, i));
+        goLive(*table->rings.back());
+    }
+    current.store(table);
+    requestedCapacity = capacity;
+
+    resizerRunning = true;
+    resizer = std::thread(resizerLoop);
+}
+
+void historyShutdown() {
+    {
+        std::lock_guard<std::mutex> lock(resizeMutex);
+        resizerRunning = false;
+    }
+    resizeCond.notify_one();
+    if (resizer.joinable()) {
+        resizer.join();
+    }
+}
+
+void historySetStorage(size_t channel, StorageMode mode) {
+    if (channel < HISTORY_MAX_CHANNELS) {
+        storageModes[channel].store(mode, std::memory_order_relaxed);
+    }
+}
+
+StorageMode historyStorage(size_t channel) {
+    if (channel < HISTORY_MAX_CHANNELS) {
+        return (StorageMode)storageModes[channel].load(std::memory_order_relaxed);
+    }
+    return STORAGE_AUTO;
+}
+
+ColdStore* historyArchive(size_t channel) {
+    if (channel < HISTORY_MAX_CHANNELS) {
+        return archives[channel].load(std::memory_order_acquire);
+    }
+    return nullptr;
+}
+
+size_t historyCapacityForBudget(size_t budgetBytes) {
+    HistoryReadGuard guard;
+    size_t capacity = SIZE_MAX;
+
+    for (const ChannelRing* ring : guard.table().rings) {
+        // Fixed part: everything bytes() counts besides the payload slots and their headers
+        size_t slots = ring->headers.size() * HISTORY_BLOCK_SIZE;
+        size_t fixed = ring->bytes() - ring->sampleBytes() * slots - ring->headers.size() * sizeof(BlockHeader);
+
+        // A rebuilt ring allocates only the kind its mode needs, AUTO the kinds its recent blocks were encoded in
+        size_t perSample;
+        switch (historyStorage(ring->channel)) {
+        case STORAGE_FLOAT32:
+            perSample = sizeof(float);
+            break;
+        case STORAGE_INT16:
+        case STORAGE_FP16:
+            perSample = sizeof(uint16_t);
+            break;
+        default:
+            perSample = ring->recentSampleBytes();
+            break;
+        }
+
+        // A ring of capacity c holds c / HISTORY_BLOCK_SIZE + 2 blocks at most
+        size_t blockBytes = HISTORY_BLOCK_SIZE * perSample + sizeof(BlockHeader);
+        size_t blocks = budgetBytes > fixed ? (budgetBytes - fixed) / blockBytes : 0;
+        capacity = std::min(capacity, blocks > 2 ? (blocks - 2) * HISTORY_BLOCK_SIZE : 0);
+    }
+    return capacity;
+}
+
+void historyRequestCapacity(size_t capacity) {
+    requestedCapacity = capacity;
+    resizeCond.notify_one();
+}
+
+HistoryTable& historyBeginWrite(size_t numChannels) {
+    // Only ever contended while the resizer swaps tables on behalf of an idle device
+    int expected = WRITER_FREE;
+    while (!writerOwner.compare_exchange_weak(expected, WRITER_INGEST, std::memory_order_acquire)) {
+        expected = WRITER_FREE;
+        std::this_thread::yield();
+    }
+
+    adoptPending();
+    growChannels(numChannels);
+
+    return *current.load(std::memory_order_relaxed);
+}
+
+void historyEndWrite() {
+    writerOwner.store(WRITER_FREE, std::memory_order_release);
+}
@@ -0,0 +1,160 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "blockStorage.h"
+#include "coldStore.h"
+
+// Channels beyond this share the default storage mode
+#define HISTORY_MAX_CHANNELS 256
+
+// Circular buffer holding the samples of one channel.
+// Samples are collected in an open float block and encoded according to the channel's
+// StorageMode once HISTORY_BLOCK_SIZE of them are in. Live rings also hand every sealed
+// block to the channel's compressed archive. Only the thread holding the writer token
+// (see historyBeginWrite) pushes into it, readers use count() to find the newest sample.
+struct ChannelRing {
+    size_t window;                          // number of samples visible to readers
+    size_t channel;                         // index used to look up the storage mode
+    std::vector<BlockHeader> headers;       // one per sealed block slot
+    std::atomic<uint16_t*> narrow;          // 16-bit payloads, allocated on first use
+    std::atomic<float*> wide;               // float32 payloads, allocated on first use
+    float open[2][HISTORY_BLOCK_SIZE];      // block being filled, double buffered for lagging readers
+    uint64_t openTimes[2][HISTORY_BLOCK_SIZE];  // arrival times in microseconds, kept for the archive
+    std::atomic<uint64_t> written;          // total number of samples ever pushed
+    ColdStore* archive;                     // set once the ring is live, null while being built
+
+    ChannelRing(size_t capacity, size_t channel);
+    ~ChannelRing();
+
+    ChannelRing(const ChannelRing&) = delete;
+    ChannelRing& operator=(const ChannelRing&) = delete;
+
+    size_t capacity() const { return window; }
+    uint64_t count() const { return written.load(std::memory_order_acquire); }
+
+    // Sample with sequence number seq, valid while seq is within the last capacity() pushes
+    float at(uint64_t seq) const;
+
+    // Decode n consecutive samples starting at seq into out
+    void read(uint64_t seq, size_t n, float* out) const;
+
+    // Decode positions [first, first + n) of the window that ends just before sequence number end.
+    // Positions before the first sample ever pushed read as zero.
+    void readWindow(uint64_t end, size_t first, size_t n, float* out) const;
+
+    // Aggregate of the samples [first, last), clipped to what has been pushed. Runs of whole archived
+    // blocks come from the archive's summaries, so this costs O(log n) plus at most three partial blocks.
+    // Without an archive it scans whatever is still held by the ring.
+    RangeSummary summarize(uint64_t first, uint64_t last) const;
+
+    // Times the signal passes level within [first, last), clipped like summarize(). Unlike the
+    // aggregates this needs every sample, so archived blocks are decoded, O(last - first).
+    uint64_t crossings(uint64_t first, uint64_t last, float level) const;
+
+    // Arrival time of an archived or recent sample, 0 if it is not known
+    uint64_t timeOf(uint64_t seq) const;
+
+    // Value that the next push() is going to drop out of the window
+    float next() const {
+        uint64_t seq = written.load(std::memory_order_relaxed);
+        return seq >= window ? at(seq - window) : 0.0f;
+    }
+
+    // Arrival time of a sample, only known while its block is one of the two most recent
+    uint64_t timeAt(uint64_t seq) const { return openTimes[(seq / HISTORY_BLOCK_SIZE) & 1][seq % HISTORY_BLOCK_SIZE]; }
+
+    void push(float value, uint64_t time) {
+        uint64_t seq = written.load(std::memory_order_relaxed);
+        open[(seq / HISTORY_BLOCK_SIZE) & 1][seq % HISTORY_BLOCK_SIZE] = value;
+        openTimes[(seq / HISTORY_BLOCK_SIZE) & 1][seq % HISTORY_BLOCK_SIZE] = time;
+        if (seq % HISTORY_BLOCK_SIZE == HISTORY_BLOCK_SIZE - 1) {
+            seal(seq / HISTORY_BLOCK_SIZE);
+        }
+        written.store(seq + 1, std::memory_order_release);
+    }
+
+    // Empty the ring and continue numbering at seq. Only for rings no reader can see yet.
+    void seek(uint64_t seq);
+
+    // Samples before the returned sequence number may have been overwritten by the time count() reaches now
+    uint64_t lostBefore(uint64_t now) const;
+
+    // Memory held by the sample storage
+    size_t bytes() const;
+
+    // Payload bytes each slot sample currently costs, 6 when a mode switch left both kinds allocated
+    size_t sampleBytes() const;
+
+    // Payload bytes per sample for the encodings the sealed blocks still held actually use,
+    // what a rebuilt AUTO ring would allocate for the same data
+    size_t recentSampleBytes() const;
+
+private:
+    void seal(uint64_t block);
+    void decodeSlot(size_t slot, size_t first, size_t n, float* out) const;
+};
+
+// Immutable set of channel rings sharing one capacity. A table is never resized in place,
+// a resized copy is published instead and the old one is reclaimed once no reader can see it.
+struct HistoryTable {
+    size_t capacity;
+    std::vector<ChannelRing*> rings;
+
+    // Unique per table, unlike its address which a reclaimed table may hand on to the next one
+    uint64_t generation;
+
+    uint64_t retireEpoch;            // epoch at which the table was unpublished
+    HistoryTable* nextRetired;       // link in the retired list
+
+    explicit HistoryTable(size_t capacity);
+    ~HistoryTable();
+};
+
+// Pins the currently published table for the lifetime of the guard.
+// Any thread may create one, the table stays valid until the guard is destroyed.
+class HistoryReadGuard {
+public:
+    HistoryReadGuard();
+    ~HistoryReadGuard();
+
+    HistoryReadGuard(const HistoryReadGuard&) = delete;
+    HistoryReadGuard& operator=(const HistoryReadGuard&) = delete;
+
+    const HistoryTable& table() const { return *table_; }
+
+private:
+    const HistoryTable* table_;
+};
+
+// Publishes the initial table and starts the background resizer thread
+void historyInit(size_t numChannels, size_t capacity);
+
+// Stops the resizer thread
+void historyShutdown();
+
+// Selects how the sealed blocks of a channel are encoded, takes effect from the next block on
+void historySetStorage(size_t channel, StorageMode mode);
+StorageMode historyStorage(size_t channel);
+
+// Compressed archive of every sealed block of a channel, null for channels beyond HISTORY_MAX_CHANNELS
+// or before the channel's first push. Archives live until the process exits.
+ColdStore* historyArchive(size_t channel);
+
+// Largest capacity at which every channel's ring fits in budgetBytes, judged from bytes() of the
+// published rings and the payload a rebuilt ring would need for its channel's storage mode
+size_t historyCapacityForBudget(size_t budgetBytes);
+
+// Asks the resizer to rebuild the history with a new capacity. Never blocks, the latest request wins.
+void historyRequestCapacity(size_t capacity);
+
+// Takes the writer token, adopts a pending resize and grows the table to numChannels if needed.
+// The returned table may only be written to until historyEndWrite() is called.
+HistoryTable& historyBeginWrite(size_t numChannels);
+void historyEndWrite();
+
+#endif // HISTORY_H
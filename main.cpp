@@ -1,9 +1,13 @@
 #include "serialPort.h"
+#include "stimulus.h"
 #include "plot.h"
+#include "trace.h"
+#include "overload.h"
 
 
 #include <windows.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 
 serial_port_t serial;
@@ -11,10 +15,95 @@ serial_port_t serial;
 HANDLE data_ready;
 
 char input_buffer[1024];
-short input_buffer_idx;
+size_t input_buffer_idx;
+bool input_buffer_overflow;     // the current line outgrew input_buffer, drop it at its newline
+
+stimulus_wave_t stimulus_wave;
+stimulus_file_t stimulus_file;
 
 void serialIRQ(char* buffer, int bytes);
 
+void printTxStats()
+{
+    serial_tx_stats_t stats;
+    serialTxGetStats(&serial, &stats);
+    printf("TX: %llu bytes sent in %llu writes from %llu enqueues, %.0f B/s, %u queued, %llu rejected, "
+           "%llu timeouts, %llu errors, %llu underruns, tick jitter mean %.0f us max %.0f us\n",
+           (unsigned long long)stats.bytesSent, (unsigned long long)stats.writes, (unsigned long long)stats.enqueues,
+           stats.throughput, stats.queued, (unsigned long long)stats.bytesRejected,
+           (unsigned long long)stats.writeTimeouts, (unsigned long long)stats.writeErrors,
+           (unsigned long long)stats.underruns, stats.jitterMeanUs, stats.jitterMaxUs);
+}
+
+// Compression of each channel's archive, against float32 values with 64 bit timestamps
+void printArchiveStats()
+{
+    for(size_t i = 0; i < HISTORY_MAX_CHANNELS; i++)
+    {
+        ColdStore* archive = historyArchive(i);
+        if(archive == NULL || archive->samples() == 0)
+            continue;
+
+        double raw = (double)archive->samples() * (sizeof(float) + sizeof(uint64_t));
+        printf("Archive %zu: %llu samples in %zu of %zu bytes, ratio %.2f\n", i, (unsigned long long)archive->samples(),
+               archive->compressedBytes(), archive->budgetBytes(), raw / archive->compressedBytes());
+    }
+}
+
+double envNumber(const char* name, double fallback)
+{
+    const char* value = getenv(name);
+    return value != NULL ? atof(value) : fallback;
+}
+
+// PLOT_STIMULUS streams to the device while plotting: sine, square, triangle, saw or a file path.
+// PLOT_STIMULUS_RATE is in samples per second for waveforms and bytes per second for files,
+// PLOT_STIMULUS_HZ, _AMPLITUDE and _OFFSET shape the waveform, PLOT_STIMULUS_LEAD_MS sets the lead buffer.
+void startStimulus()
+{
+    const char* name = getenv("PLOT_STIMULUS");
+    if(name == NULL)
+        return;
+
+    double rate = envNumber("PLOT_STIMULUS_RATE", 100);
+    uint32_t leadMs = (uint32_t)envNumber("PLOT_STIMULUS_LEAD_MS", 50);
+
+    if(serialTxStart(&serial) != SERIAL_ERR_OK)
+    {
+        printf("Transmit queue unavailable\n");
+        return;
+    }
+
+    stimulus_shape_t shape;
+    if(stimulusShapeFromName(name, &shape) == 0)
+    {
+        stimulusWaveInit(&stimulus_wave, shape, envNumber("PLOT_STIMULUS_HZ", 1), envNumber("PLOT_STIMULUS_AMPLITUDE", 100),
+                         envNumber("PLOT_STIMULUS_OFFSET", 0), rate);
+        serialTxStream(&serial, stimulusWaveSource, &stimulus_wave, leadMs);
+    }
+    else if(stimulusFileOpen(&stimulus_file, name, rate, 1) == 0)
+    {
+        serialTxStream(&serial, stimulusFileSource, &stimulus_file, leadMs);
+    }
+    else
+    {
+        printf("Stimulus %s is neither a waveform nor a readable file\n", name);
+    }
+}
+
+// Ctrl+Break dumps the trace buffers, the transmit stats and the archive compression without closing the plotter
+BOOL WINAPI consoleHandler(DWORD event)
+{
+    if(event == CTRL_BREAK_EVENT)
+    {
+        traceDumpNext();
+        printTxStats();
+        printArchiveStats();
+        return TRUE;
+    }
+    return FALSE;
+}
+
 int main(){
 
 
@@ -26,10 +115,37 @@ int main(){
 
     data_ready = CreateSemaphore(NULL, 0, 1, NULL);
 
+    // PLOT_TRACE=1 records from the start, F8 toggles recording and F9 dumps from the plot window
+    if(getenv("PLOT_TRACE") != NULL)
+        traceEnable(1);
+    SetConsoleCtrlHandler(consoleHandler, TRUE);
+
+    // PLOT_STORAGE=auto|float32|int16|fp16 picks how history blocks are stored, F6 cycles it later
+    const char* storage = getenv("PLOT_STORAGE");
+    StorageMode mode;
+    if(storage != NULL && storageModeFromName(storage, mode))
+    {
+        for(size_t i = 0; i < HISTORY_MAX_CHANNELS; i++)
+            historySetStorage(i, mode);
+    }
+
+    initPlot();
+
     enableSerialEvent(&serial, serialIRQ);
 
+    startStimulus();
+
     startOpenGL();
 
+    if(serial.tx != NULL)
+    {
+        serialTxStop(&serial);
+        printTxStats();
+    }
+    stimulusFileClose(&stimulus_file);
+
+    closePlot();
+
     // while(1){
     //     Sleep(100000);
     // }
@@ -42,25 +158,55 @@ int main(){
 
 void serialIRQ(char* buffer, int bytes){
 
-    int a0, a1, a2;
+    TRACE_SCOPE("serialIRQ");
+
+    // The chunk size is the queue the driver had built up, the policy reads falling behind from it
+    overloadReportIngest(bytes, serial.rxOverruns, serial.rxReadErrors);
+    overloadCount(OVERLOAD_BYTES, bytes);
+
+    int a0 = 0, a1 = 0, a2 = 0;
+    int lines = 0;
 
     for(int i=0; i<bytes; i++)
     {
-        input_buffer[input_buffer_idx++] = buffer[i];
-        if(buffer[i] == '\n')
+        if(buffer[i] != '\n')
         {
-            sscanf(input_buffer, "%d %d %d\n", &a0, &a1, &a2);
-            input_buffer_idx = 0;
+            if(input_buffer_idx < sizeof(input_buffer) - 1)
+                input_buffer[input_buffer_idx++] = buffer[i];
+            else
+                input_buffer_overflow = true;
+            continue;
+        }
+
+        input_buffer[input_buffer_idx] = '\0';
 
-            ReleaseSemaphore(data_ready, 1, NULL);
+        if(input_buffer_overflow)
+            overloadCount(OVERLOAD_TRUNCATED);
+        else if(sscanf(input_buffer, "%d %d %d", &a0, &a1, &a2) != 3)
+            overloadCount(OVERLOAD_MALFORMED);
+        else
+        {
+            lines++;
+            if(overloadKeepLine())
+                push_data(4, (float)a0, (float)a1, (float)a2, (float)(rand()%255));
         }
 
+        input_buffer_idx = 0;
+        input_buffer_overflow = false;
     }
 
-    // printf("%*s", bytes, buffer);
+    TRACE_COUNTER("lines per callback", lines);
+
+    if(lines == 0)
+        return;
 
-    push_data(4, (float)a0, (float)a1, (float)a2, (float)(rand()%255));
+    overloadCount(OVERLOAD_LINES, lines);
+    ReleaseSemaphore(data_ready, 1, NULL);
 
-    printf("%d %d %d\n", a0, a1, a2);
+    // printf("%*s", bytes, buffer);
 
-}
\ No newline at end of file
+    // Echoing is the first thing to go when the plotter falls behind
+    if(overloadEcho())
+        printf("%d %d %d\n", a0, a1, a2);
+
+}
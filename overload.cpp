@@ -0,0 +1,174 @@
+#include "overload.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+using namespace std;
+
+static std::atomic<int> level(OVERLOAD_NORMAL);
+static std::atomic<uint64_t> counters[OVERLOAD_COUNTERS];
+
+// Exponentially smoothed inputs, each written by one thread only
+static std::atomic<uint32_t> backlogAverage(0);
+static std::atomic<uint32_t> frameAverage(0);
+static std::atomic<int64_t> lastIngestMs(0);
+static std::atomic<uint64_t> overrunsSeen(0);
+static std::atomic<uint64_t> readErrorsSeen(0);
+static std::atomic<bool> overrunPending(false);
+
+// Policy state, only touched by whoever holds policyMutex
+static std::mutex policyMutex;
+static std::chrono::steady_clock::time_point lastChange = std::chrono::steady_clock::now();
+static std::chrono::steady_clock::time_point calmSince = std::chrono::steady_clock::now();
+static bool calm = true;
+
+static const char* levelNames[OVERLOAD_LEVELS] = {"normal", "no echo", "decimate", "drop frames"};
+
+static uint32_t smooth(uint32_t average, uint32_t sample) {
+    return (uint32_t)(((uint64_t)average * 7 + sample) / 8);
+}
+
+static int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The average only moves when data arrives, so age it by the time since the last read
+static uint32_t currentBacklog() {
+    int64_t idle = nowMs() - lastIngestMs.load(std::memory_order_relaxed);
+    int64_t halvings = idle > 0 ? idle / OVERLOAD_BACKLOG_HALF_LIFE_MS : 0;
+    return halvings < 32 ? backlogAverage.load(std::memory_order_relaxed) >> halvings : 0;
+}
+
+static void setLevel(int next, std::chrono::steady_clock::time_point now) {
+    int previous = level.exchange(next);
+    lastChange = now;
+    counters[OVERLOAD_LEVEL_CHANGES]++;
+    TRACE_COUNTER("overload level", next);
+    printf("Overload: %s -> %s\n", levelNames[previous], levelNames[next]);
+}
+
+// Step one level up under pressure, one level down after a calm period
+static void evaluate() {
+    // Both stages report, whoever comes second simply skips this round
+    std::unique_lock<std::mutex> lock(policyMutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    uint32_t backlog = currentBacklog();
+    uint32_t frame = frameAverage.load(std::memory_order_relaxed);
+    bool overrun = overrunPending.exchange(false);
+
+    bool pressure = overrun || backlog > OVERLOAD_BACKLOG_HIGH || frame > OVERLOAD_FRAME_HIGH_US;
+    bool quiet = !overrun && backlog < OVERLOAD_BACKLOG_LOW && frame < OVERLOAD_FRAME_LOW_US;
+
+    if (!quiet) {
+        calm = false;
+    } else if (!calm) {
+        calm = true;
+        calmSince = now;
+    }
+
+    int current = level.load(std::memory_order_relaxed);
+    if (pressure && current + 1 < OVERLOAD_LEVELS && now - lastChange >= std::chrono::milliseconds(OVERLOAD_ESCALATE_MS)) {
+        setLevel(current + 1, now);
+    } else if (calm && current > OVERLOAD_NORMAL && now - calmSince >= std::chrono::milliseconds(OVERLOAD_RECOVER_MS)
+               && now - lastChange >= std::chrono::milliseconds(OVERLOAD_RECOVER_MS)) {
+        setLevel(current - 1, now);
+    }
+}
+
+void overloadCount(OverloadCounter counter, uint64_t n) {
+    counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+void overloadReportIngest(uint32_t backlogBytes, uint64_t overrunsTotal, uint64_t readErrorsTotal) {
+    backlogAverage.store(smooth(currentBacklog(), backlogBytes), std::memory_order_relaxed);
+    lastIngestMs.store(nowMs(), std::memory_order_relaxed);
+
+    uint64_t seen = overrunsSeen.exchange(overrunsTotal);
+    if (overrunsTotal > seen) {
+        counters[OVERLOAD_OVERRUNS].fetch_add(overrunsTotal - seen, std::memory_order_relaxed);
+        overrunPending = true;
+    }
+
+    // Lost reads are reported but do not say the plotter is behind, they do not escalate
+    seen = readErrorsSeen.exchange(readErrorsTotal);
+    if (readErrorsTotal > seen) {
+        counters[OVERLOAD_READ_ERRORS].fetch_add(readErrorsTotal - seen, std::memory_order_relaxed);
+    }
+
+    evaluate();
+}
+
+void overloadReportFrame(uint32_t workUs) {
+    frameAverage.store(smooth(frameAverage.load(std::memory_order_relaxed), workUs), std::memory_order_relaxed);
+    evaluate();
+}
+
+OverloadLevel overloadLevel() {
+    return (OverloadLevel)level.load(std::memory_order_relaxed);
+}
+
+const char* overloadLevelName(OverloadLevel level) {
+    return level < OVERLOAD_LEVELS ? levelNames[level] : "?";
+}
+
+bool overloadEcho() {
+    return overloadLevel() < OVERLOAD_NO_ECHO;
+}
+
+bool overloadKeepLine() {
+    static uint32_t line = 0;   // ingest thread only
+
+    if (overloadLevel() < OVERLOAD_DECIMATE) {
+        return true;
+    }
+    if (line++ % OVERLOAD_DECIMATION == 0) {
+        return true;
+    }
+    counters[OVERLOAD_DECIMATED].fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool overloadKeepFrame() {
+    static uint32_t frame = 0;  // render thread only
+
+    if (overloadLevel() < OVERLOAD_DROP_FRAMES) {
+        return true;
+    }
+    if (frame++ % 2 == 0) {
+        return true;
+    }
+    counters[OVERLOAD_DROPPED_FRAMES].fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+OverloadStats overloadStats() {
+    OverloadStats stats;
+    stats.level = overloadLevel();
+    for (size_t i = 0; i < OVERLOAD_COUNTERS; ++i) {
+        stats.counters[i] = counters[i].load(std::memory_order_relaxed);
+    }
+    stats.backlogBytes = currentBacklog();
+    stats.frameWorkUs = frameAverage.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void overloadFormat(char* out, size_t size) {
+    OverloadStats stats = overloadStats();
+    snprintf(out, size, "%s | lines %llu malformed %llu truncated %llu overruns %llu read errors %llu decimated %llu dropped frames %llu archive full %llu",
+             overloadLevelName(stats.level),
+             (unsigned long long)stats.counters[OVERLOAD_LINES],
+             (unsigned long long)stats.counters[OVERLOAD_MALFORMED],
+             (unsigned long long)stats.counters[OVERLOAD_TRUNCATED],
+             (unsigned long long)stats.counters[OVERLOAD_OVERRUNS],
+             (unsigned long long)stats.counters[OVERLOAD_READ_ERRORS],
+             (unsigned long long)stats.counters[OVERLOAD_DECIMATED],
+             (unsigned long long)stats.counters[OVERLOAD_DROPPED_FRAMES],
+             (unsigned long long)stats.counters[OVERLOAD_ARCHIVE_FULL]);
+}
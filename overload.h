@@ -0,0 +1,73 @@
+#ifndef OVERLOAD_H
+#define OVERLOAD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Degradation steps, each one includes the previous ones
+enum OverloadLevel {
+    OVERLOAD_NORMAL,        // everything enabled
+    OVERLOAD_NO_ECHO,       // stop echoing parsed lines to the console
+    OVERLOAD_DECIMATE,      // keep one in OVERLOAD_DECIMATION parsed lines
+    OVERLOAD_DROP_FRAMES,   // render every other frame
+    OVERLOAD_LEVELS
+};
+
+enum OverloadCounter {
+    OVERLOAD_BYTES,             // bytes handed to serialIRQ
+    OVERLOAD_LINES,             // lines parsed successfully
+    OVERLOAD_MALFORMED,         // lines that did not parse
+    OVERLOAD_TRUNCATED,         // lines longer than the line buffer, dropped
+    OVERLOAD_OVERRUNS,          // driver reported receive overruns
+    OVERLOAD_READ_ERRORS,       // failed receive reads, their bytes are lost
+    OVERLOAD_DECIMATED,         // parsed lines skipped by ingest decimation
+    OVERLOAD_DROPPED_FRAMES,    // frames skipped by the renderer
+    OVERLOAD_ARCHIVE_FULL,      // sealed blocks the cold archive had no room or budget for
+    OVERLOAD_LEVEL_CHANGES,     // policy transitions in either direction
+    OVERLOAD_COUNTERS
+};
+
+// One in this many parsed lines is kept while decimating
+#define OVERLOAD_DECIMATION 4
+
+// Bytes waiting per read and render work per frame that count as falling behind, and as recovered
+#define OVERLOAD_BACKLOG_HIGH 2048
+#define OVERLOAD_BACKLOG_LOW 256
+#define OVERLOAD_FRAME_HIGH_US 50000
+#define OVERLOAD_FRAME_LOW_US 20000
+
+// Minimum time between escalations, and how long things must stay calm before stepping back
+#define OVERLOAD_ESCALATE_MS 250
+#define OVERLOAD_RECOVER_MS 2000
+
+// The smoothed backlog halves for every this long without a read, a quiet device has nothing queued
+#define OVERLOAD_BACKLOG_HALF_LIFE_MS 100
+
+struct OverloadStats {
+    OverloadLevel level;
+    uint64_t counters[OVERLOAD_COUNTERS];
+    uint32_t backlogBytes;      // smoothed bytes per read, decayed while no reads come in
+    uint32_t frameWorkUs;       // smoothed render work per frame
+};
+
+void overloadCount(OverloadCounter counter, uint64_t n = 1);
+
+// Feed the policy: bytes the ingest thread found queued on a read, render work of one frame.
+// The totals are the port's running counts, only what changed since the last report is counted.
+void overloadReportIngest(uint32_t backlogBytes, uint64_t overrunsTotal, uint64_t readErrorsTotal);
+void overloadReportFrame(uint32_t workUs);
+
+OverloadLevel overloadLevel();
+const char* overloadLevelName(OverloadLevel level);
+
+// Decisions taken by the stages, each counts what it drops
+bool overloadEcho();
+bool overloadKeepLine();
+bool overloadKeepFrame();
+
+OverloadStats overloadStats();
+
+// Short one line summary of overloadStats(), e.g. for the window title
+void overloadFormat(char* out, size_t size);
+
+#endif // OVERLOAD_H
@@ -1,4 +1,8 @@
 #include "plot.h"
+#include "history.h"
+#include "workerPool.h"
+#include "trace.h"
+#include "overload.h"
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
@@ -8,22 +12,26 @@
 #include <algorithm>
 #include <limits>
 #include <cstdarg>
+#include <cmath>
 #include <atomic>
+#include <chrono>
 #include <mutex>
+#include <condition_variable>
+#include <string>
+#include <thread>
+#include <cstdlib>
 
 using namespace std;
 
-#define MAX_BUFFER_SIZE 10000
+// Memory each channel's history may take. The window it allows depends on the storage mode:
+// about 14k samples as float32, twice that in int16 or fp16 blocks.
+#define HISTORY_BUDGET_BYTES (64 * 1024)
 
 extern HANDLE data_ready;
 
 const unsigned int WIDTH = 800;
 const unsigned int HEIGHT = 600;
-size_t bufferSize = 100;
-
-// Pre-allocated buffers to store data history (Circular Buffers)
-std::vector<std::vector<float>> histories;
-std::vector<size_t> heads;
+size_t bufferSize = 100;   // requested history window, the published table follows it asynchronously
 
 float currentMinAmplitude = std::numeric_limits<float>::max();
 float currentMaxAmplitude = std::numeric_limits<float>::lowest();
@@ -31,6 +39,31 @@ float minAmplitude = 0.0f;
 float maxAmplitude = 1.0f;
 std::atomic<bool> requiresRescan(false);
 
+// Measurement cursors as sequence numbers, so they stay on their samples while the plot scrolls.
+// Only touched on the GL thread, the input callbacks run from glfwPollEvents.
+int64_t cursorSeq[2] = {-1, -1};
+size_t readoutChannel = 0;
+bool cursorsMoved = false;
+bool titleStale = false;
+
+// Cursor readouts are formatted on their own thread, the crossing count decodes every sample between
+// the cursors. The GL thread posts the cursors and picks up one line per channel once they are done.
+static std::thread readoutThread;
+static std::mutex readoutMutex;
+static std::condition_variable readoutCond;
+static bool readoutStop = false;
+static uint64_t readoutRequested = 0;          // generation of the newest cursor positions
+static uint64_t readoutFinished = 0;           // generation readoutLines belong to
+static int64_t readoutCursors[2] = {-1, -1};
+static std::vector<std::string> readoutLines;
+static std::atomic<bool> readoutReady(false);
+
+// Last finished readout per channel, GL thread only. The title picks from it without recomputing.
+std::vector<std::string> cursorReadouts;
+
+// Level the cursor readout counts crossings of, NaN for the mean between the cursors. Set by PLOT_CROSSING_LEVEL.
+double crossingLevel = std::nan("");
+
 const std::vector<std::array<float, 3>> colorSet = {
     {1.0f, 0.0f, 0.0f},   // Red
     {0.0f, 1.0f, 0.0f},   // Green
@@ -67,34 +100,114 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glMatrixMode(GL_MODELVIEW);
 }
 
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-    const size_t minBufferSize = 10;
-    const size_t maxBufferSize = MAX_BUFFER_SIZE;
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action != GLFW_PRESS) {
+        return;
+    }
+
+    if (key == GLFW_KEY_F8) {
+        traceEnable(!traceIsActive());
+        printf("Tracing %s\n", traceIsActive() ? "on" : "off");
+    } else if (key == GLFW_KEY_F9) {
+        traceDumpNext();
+    } else if (key == GLFW_KEY_F6) {
+        // Cycle every channel through auto, float32, int16 and fp16
+        StorageMode mode = (StorageMode)((historyStorage(0) + 1) % (STORAGE_FP16 + 1));
+        for (size_t i = 0; i < HISTORY_MAX_CHANNELS; ++i) {
+            historySetStorage(i, mode);
+        }
+
+        // float32 fits a smaller window in the same budget
+        size_t maxBufferSize = historyCapacityForBudget(HISTORY_BUDGET_BYTES);
+        printf("Storage %s, window up to %zu samples\n", storageModeName(mode), maxBufferSize);
+        if (bufferSize > maxBufferSize) {
+            bufferSize = std::max<size_t>(maxBufferSize, 10);
+            historyRequestCapacity(bufferSize);
+        }
+    } else if (key == GLFW_KEY_DELETE) {
+        cursorSeq[0] = cursorSeq[1] = -1;
+        cursorsMoved = true;
+    } else if (key == GLFW_KEY_TAB) {
+        readoutChannel++;
+        titleStale = true;
+    }
+}
 
-    if (yoffset > 0 && bufferSize < maxBufferSize) {
-        bufferSize += 10;
-    } else if (yoffset < 0 && bufferSize > minBufferSize) {
-        bufferSize -= 10;
+// Left button places cursor A, right button cursor B, on the sample under the mouse
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    if (action != GLFW_PRESS || (button != GLFW_MOUSE_BUTTON_LEFT && button != GLFW_MOUSE_BUTTON_RIGHT)) {
+        return;
     }
 
-    for (auto& history : histories) {
-        history.resize(bufferSize, 0.0f);
+    double mouseX, mouseY;
+    int width, height;
+    glfwGetCursorPos(window, &mouseX, &mouseY);
+    glfwGetWindowSize(window, &width, &height);
+    if (width <= 0 || height <= 0) {
+        return;
     }
 
-    for (auto& head : heads) {
-        head = head % bufferSize;
+    HistoryReadGuard guard;
+    const HistoryTable& table = guard.table();
+    if (table.rings.empty() || table.capacity < 2) {
+        return;
     }
+
+    // Invert the x mapping of buildVertices under the projection set up in framebuffer_size_callback
+    float aspectRatio = (float)width / (float)height;
+    float x = ((float)mouseX / (float)width * 2.0f - 1.0f) * std::max(aspectRatio, 1.0f);
+    float stepX = 2.0f / (float)(table.capacity - 1) * aspectRatio;
+    float position = std::round((x + aspectRatio) / stepX);
+    position = std::min(std::max(position, 0.0f), (float)(table.capacity - 1));
+
+    int64_t end = (int64_t)table.rings[0]->count();
+    int64_t seq = std::max<int64_t>(end - (int64_t)table.capacity + (int64_t)position, 0);
+
+    cursorSeq[button == GLFW_MOUSE_BUTTON_LEFT ? 0 : 1] = seq;
+    cursorsMoved = true;
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+    const size_t minBufferSize = 10;
+    const size_t maxBufferSize = std::max(historyCapacityForBudget(HISTORY_BUDGET_BYTES), minBufferSize);
+
+    // Steps grow with the window so the whole budget stays within reach of the wheel
+    size_t step = std::max<size_t>(10, bufferSize / 10 / 10 * 10);
+    if (yoffset > 0) {
+        bufferSize = std::min(bufferSize + step, maxBufferSize);
+    } else if (yoffset < 0) {
+        bufferSize = bufferSize > minBufferSize + step ? bufferSize - step : minBufferSize;
+    }
+    bufferSize = std::min(bufferSize, maxBufferSize);
+
+    // The resizer rebuilds the histories off-thread and swaps them in, keeping samples in order
+    historyRequestCapacity(bufferSize);
 }
 
 // Function to scan all histories for the new min and max
-void rescanAmplitudeRange() {
+void rescanAmplitudeRange(const HistoryTable& table) {
+    TRACE_SCOPE("rescanAmplitudeRange");
+    static int64_t rescans = 0;
+    TRACE_COUNTER("rescans", ++rescans);
+
     currentMinAmplitude = std::numeric_limits<float>::max();
     currentMaxAmplitude = std::numeric_limits<float>::lowest();
     
-    for (size_t i = 0; i < bufferSize; ++i) {
-        for (size_t j = 0; j < histories.size(); ++j) {
-            currentMinAmplitude = std::min(currentMinAmplitude, histories[j][i]);
-            currentMaxAmplitude = std::max(currentMaxAmplitude, histories[j][i]);
+    for (const ChannelRing* ring : table.rings) {
+        uint64_t end = ring->count();
+        uint64_t seq = end > table.capacity ? end - table.capacity : 0;
+
+        // Slots that were never written are drawn as zero
+        if (end < table.capacity) {
+            currentMinAmplitude = std::min(currentMinAmplitude, 0.0f);
+            currentMaxAmplitude = std::max(currentMaxAmplitude, 0.0f);
+        }
+
+        // Whole archived blocks come from the summary tree, only the edges are decoded
+        RangeSummary summary = ring->summarize(seq, end);
+        if (summary.count) {
+            currentMinAmplitude = std::min(currentMinAmplitude, summary.minValue);
+            currentMaxAmplitude = std::max(currentMaxAmplitude, summary.maxValue);
         }
     }
     
@@ -104,26 +217,37 @@ void rescanAmplitudeRange() {
 }
 
 void push_data(size_t num_vars, ...) {
+    TRACE_SCOPE("push_data");
+
+    static uint64_t lastGeneration = 0;
+
     va_list args;
     va_start(args, num_vars);
 
-    // Resize histories and heads if needed
-    if (histories.size() < num_vars) {
-        histories.resize(num_vars, std::vector<float>(bufferSize, 0.0f));
-        heads.resize(num_vars, 0);
+    // Adopts a pending resize and adds channels if needed
+    HistoryTable& table = historyBeginWrite(num_vars);
+
+    // All channels of one line share the arrival time, kept in microseconds for the archive
+    uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    // Samples may have been dropped or added by a resize, the running min/max is stale
+    if (table.generation != lastGeneration) {
+        requiresRescan = true;
+        lastGeneration = table.generation;
     }
 
     // Push the new data
     for (size_t i = 0; i < num_vars; ++i) {
         float value = static_cast<float>(va_arg(args, double)); // Use double because va_arg promotes float to double
 
+        ChannelRing& ring = *table.rings[i];
+
         // Check if the value to be overwritten is the current min or max
-        if (histories[i][heads[i]] == currentMinAmplitude || histories[i][heads[i]] == currentMaxAmplitude) {
+        if (ring.next() == currentMinAmplitude || ring.next() == currentMaxAmplitude) {
             requiresRescan = true;
         }
 
-        histories[i][heads[i]] = value;
-        heads[i] = (heads[i] + 1) % bufferSize;
+        ring.push(value, now);
 
         // Update running min/max
         if (!requiresRescan) {
@@ -141,31 +265,220 @@ void push_data(size_t num_vars, ...) {
 
     // Rescan if required
     if (requiresRescan) {
-        rescanAmplitudeRange();
+        rescanAmplitudeRange(table);
         requiresRescan = false;
     }
+
+    historyEndWrite();
 }
 
-// Draw the data, normalizing y-coordinates based on min/max amplitude
-void drawData(const std::vector<float> &history, size_t head, float offsetY, float aspectRatio, float r, float g, float b) {
+// Turn the visible window of one channel into line strip vertices (x, y pairs), normalizing
+// y-coordinates based on min/max amplitude. Runs on the worker pool, touches no GL state.
+void buildVertices(const ChannelRing& history, float minValue, float maxValue, float offsetY, float aspectRatio, size_t columns, std::vector<float>& vertices) {
+    size_t capacity = history.capacity();
+    uint64_t end = history.count();
+    float samples[HISTORY_BLOCK_SIZE];
+
+    // y = ((v - min) / (max - min)) * 2 - 1 + offset, folded into one multiply-add
+    float scaleY = 2.0f / (maxValue - minValue);
+    float biasY = -1.0f - minValue * scaleY + offsetY;
+    float stepX = 2.0f / (float)(capacity - 1) * aspectRatio;
+    float startX = -aspectRatio;
+
+    vertices.clear();
+
+    if (capacity <= 2 * columns) {
+        // Fewer samples than pixels worth decimating, one vertex per sample
+        vertices.resize(2 * capacity);
+        float* out = vertices.data();
+        for (size_t i = 0; i < capacity; i += HISTORY_BLOCK_SIZE) {
+            size_t n = std::min<size_t>(HISTORY_BLOCK_SIZE, capacity - i);
+            history.readWindow(end, i, n, samples);
+            for (size_t k = 0; k < n; ++k) {
+                *out++ = startX + (float)(i + k) * stepX;
+                *out++ = samples[k] * scaleY + biasY;
+            }
+        }
+        return;
+    }
+
+    // Min/max decimation: two vertices per pixel column keep every peak visible
+    vertices.reserve(4 * columns);
+    size_t column = 0;
+    size_t columnEnd = capacity / columns;
+    size_t columnStart = 0;
+    float lo = std::numeric_limits<float>::max();
+    float hi = std::numeric_limits<float>::lowest();
+    size_t loAt = 0;
+    size_t hiAt = 0;
+
+    for (size_t i = 0; i < capacity; i += HISTORY_BLOCK_SIZE) {
+        size_t n = std::min<size_t>(HISTORY_BLOCK_SIZE, capacity - i);
+        history.readWindow(end, i, n, samples);
+        for (size_t k = 0; k < n; ++k) {
+            if (samples[k] < lo) {
+                lo = samples[k];
+                loAt = i + k;
+            }
+            if (samples[k] > hi) {
+                hi = samples[k];
+                hiAt = i + k;
+            }
+
+            if (i + k + 1 == columnEnd) {
+                // Emit the extremes in the order they occurred so the strip stays continuous
+                float x = startX + (float)columnStart * stepX;
+                vertices.push_back(x);
+                vertices.push_back((loAt < hiAt ? lo : hi) * scaleY + biasY);
+                vertices.push_back(x);
+                vertices.push_back((loAt < hiAt ? hi : lo) * scaleY + biasY);
+
+                column++;
+                columnStart = columnEnd;
+                columnEnd = (column + 1) * capacity / columns;
+                lo = std::numeric_limits<float>::max();
+                hi = std::numeric_limits<float>::lowest();
+            }
+        }
+    }
+}
+
+// Submit one channel's prepared vertices
+void drawData(const std::vector<float>& vertices, float r, float g, float b) {
     glColor3f(r, g, b); // Set the color
-    glBegin(GL_LINE_STRIP);
-    for (size_t i = 0; i < bufferSize; ++i) {
-        size_t index = (head + i) % bufferSize;
-        float x = (float)i / (float)(bufferSize - 1) * 2.0f - 1.0f; // Normalize to [-1, 1]
-        // Normalize to [-1, 1] based on min/max amplitude and add offset for multiple waves
-        float y = ((history[index] - minAmplitude) / (maxAmplitude - minAmplitude)) * 2.0f - 1.0f; 
-        y += offsetY; // Offset for multiple waves
-        glVertex2f(x * aspectRatio, y);
+    glVertexPointer(2, GL_FLOAT, 0, vertices.data());
+    glDrawArrays(GL_LINE_STRIP, 0, (GLsizei)(vertices.size() / 2));
+}
+
+// Vertical lines at the cursors that are inside the visible window
+void drawCursors(const ChannelRing& history, float aspectRatio) {
+    size_t capacity = history.capacity();
+    int64_t windowStart = (int64_t)history.count() - (int64_t)capacity;
+    float stepX = 2.0f / (float)(capacity - 1) * aspectRatio;
+
+    float lines[8];
+    GLsizei vertices = 0;
+    for (int64_t seq : cursorSeq) {
+        if (seq < 0 || seq < windowStart || seq >= windowStart + (int64_t)capacity) {
+            continue;
+        }
+        float x = -aspectRatio + (float)(seq - windowStart) * stepX;
+        lines[2 * vertices] = x;
+        lines[2 * vertices + 1] = -1.0f;
+        lines[2 * vertices + 2] = x;
+        lines[2 * vertices + 3] = 1.0f;
+        vertices += 2;
+    }
+    if (vertices == 0) {
+        return;
     }
-    glEnd();
+
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glVertexPointer(2, GL_FLOAT, 0, lines);
+    glDrawArrays(GL_LINES, 0, vertices);
 }
 
-void startOpenGL() {
-    // Initialize the data structures for plotting
-    histories.resize(1, std::vector<float>(bufferSize, 0.0f));
-    heads.resize(1, 0);
+// Statistics of one channel between sequence numbers first and last, both included.
+// O(last - first) for the crossing count, so it runs on the readout thread.
+void formatCursorReadout(const ChannelRing& history, size_t channel, uint64_t first, uint64_t last, char* out, size_t size) {
+    RangeSummary summary = history.summarize(first, last + 1);
+    if (summary.count == 0) {
+        snprintf(out, size, "ch%zu: no samples between the cursors", channel);
+        return;
+    }
+
+    // Times in ms relative to the earlier cursor, unknown ones print as nan
+    uint64_t origin = history.timeOf(first);
+    auto since = [&](uint64_t seq) {
+        uint64_t time = history.timeOf(seq);
+        return origin && time ? (double)(int64_t)(time - origin) / 1000.0 : std::nan("");
+    };
+    double span = since(first + summary.count - 1);
+    double minAt = since(summary.minSeq);
+    double maxAt = since(summary.maxSeq);
+
+    // Crossings need every sample, decoded block by block, the aggregates above did not
+    double level = std::isnan(crossingLevel) ? summary.mean() : crossingLevel;
+    uint64_t crossings = history.crossings(first, last + 1, (float)level);
+
+    snprintf(out, size, "ch%zu: %llu samples %.1f ms, min %g @%.1f ms, max %g @%.1f ms, p-p %g, mean %.4g, rms %.4g, sd %.4g, "
+             "%llu crossings of %.4g",
+             channel, (unsigned long long)summary.count, span, summary.minValue, minAt, summary.maxValue, maxAt,
+             summary.peakToPeak(), summary.mean(), summary.rms(), summary.stddev(), (unsigned long long)crossings, level);
+}
+
+// Formats the readouts of the newest cursor positions, a request posted meanwhile is picked up next round
+static void readoutLoop() {
+    traceSetThreadName("readout");
+
+    std::unique_lock<std::mutex> lock(readoutMutex);
+    while (true) {
+        readoutCond.wait(lock, [] { return readoutStop || readoutRequested != readoutFinished; });
+        if (readoutStop) {
+            return;
+        }
+        uint64_t generation = readoutRequested;
+        int64_t cursors[2] = {readoutCursors[0], readoutCursors[1]};
+        lock.unlock();
+
+        std::vector<std::string> lines;
+        if (cursors[0] >= 0 && cursors[1] >= 0) {
+            TRACE_SCOPE("formatCursorReadout");
+            HistoryReadGuard guard;
+            const HistoryTable& table = guard.table();
+            char readout[320];
+            for (size_t i = 0; i < table.rings.size(); ++i) {
+                formatCursorReadout(*table.rings[i], i, (uint64_t)std::min(cursors[0], cursors[1]),
+                                    (uint64_t)std::max(cursors[0], cursors[1]), readout, sizeof(readout));
+                lines.push_back(readout);
+            }
+        }
+
+        lock.lock();
+        readoutFinished = generation;
+        readoutLines.swap(lines);
+        readoutReady = true;
+    }
+}
+
+static void requestReadout() {
+    {
+        std::lock_guard<std::mutex> lock(readoutMutex);
+        readoutCursors[0] = cursorSeq[0];
+        readoutCursors[1] = cursorSeq[1];
+        readoutRequested++;
+    }
+    readoutCond.notify_one();
+}
+
+// Takes the finished readouts if they belong to the newest cursor positions, false otherwise
+static bool collectReadout() {
+    if (!readoutReady.exchange(false)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(readoutMutex);
+    if (readoutFinished != readoutRequested) {
+        return false;
+    }
+    cursorReadouts = readoutLines;
+    return true;
+}
+
+void initPlot() {
+    // Initialize the data structures for plotting, must happen before the serial thread pushes data
+    historyInit(1, bufferSize);
+
+    const char* level = getenv("PLOT_CROSSING_LEVEL");
+    if (level != NULL) {
+        crossingLevel = atof(level);
+    }
+}
+
+void closePlot() {
+    historyShutdown();
+}
 
+void startOpenGL() {
     if (!glfwInit()) {
         return;
     }
@@ -179,28 +492,122 @@ void startOpenGL() {
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetScrollCallback(window, scroll_callback); // Set the scroll callback
+    glfwSetKeyCallback(window, key_callback);       // F6 cycles the storage mode, F8 toggles tracing, F9 dumps it
+    glfwSetMouseButtonCallback(window, mouse_button_callback);  // Cursors, Tab picks the channel in the title
 
     framebuffer_size_callback(window, WIDTH, HEIGHT); // Set initial viewport and projection
 
+    // Per-channel vertex generation runs on these, the GL thread only uploads and draws
+    WorkerPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    std::vector<std::vector<float>> channelVertices;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+
+    readoutStop = false;
+    readoutThread = std::thread(readoutLoop);
+
+    traceSetThreadName("render");
+    uint64_t lastFrame = traceNow();
+    uint64_t lastTitle = lastFrame;
+
     while (!glfwWindowShouldClose(window)) {
+        TRACE_SCOPE("frame");
+
         glClear(GL_COLOR_BUFFER_BIT);
 
         int width, height;
         glfwGetFramebufferSize(window, &width, &height);
         float aspectRatio = (float)width / (float)height;
 
-        WaitForSingleObject(data_ready, 10);
+        {
+            TRACE_SCOPE("wait data_ready");
+            WaitForSingleObject(data_ready, 10);
+        }
+
+        // Skipped frames keep the window responsive but leave the CPU to ingest
+        if (!overloadKeepFrame()) {
+            glfwPollEvents();
+            continue;
+        }
 
-        // Draw each history with different colors
-        for (size_t i = 0; i < histories.size(); ++i) {
-            const auto& color = colorSet[i % colorSet.size()];
-            drawData(histories[i], heads[i], 0.0f, aspectRatio, color[0], color[1], color[2]);
+        uint64_t workStart = traceNow();
+
+        // Draw each history with different colors, the guard keeps the table alive across a resize
+        {
+            HistoryReadGuard guard;
+            const HistoryTable& table = guard.table();
+
+            // Same scale for every channel even if the serial thread updates it mid-frame
+            float minValue = minAmplitude;
+            float maxValue = maxAmplitude;
+            size_t columns = std::max(width, 1);
+
+            channelVertices.resize(table.rings.size());
+            pool.parallelFor(table.rings.size(), [&](size_t i) {
+                TRACE_SCOPE("buildVertices");
+                buildVertices(*table.rings[i], minValue, maxValue, 0.0f, aspectRatio, columns, channelVertices[i]);
+            });
+
+            TRACE_SCOPE("drawData");
+            for (size_t i = 0; i < table.rings.size(); ++i) {
+                const auto& color = colorSet[i % colorSet.size()];
+                drawData(channelVertices[i], color[0], color[1], color[2]);
+            }
+            if (!table.rings.empty()) {
+                drawCursors(*table.rings[0], aspectRatio);
+            }
         }
 
+        // Swap waits for vsync, only the work before it counts as render load
+        overloadReportFrame((uint32_t)((traceNow() - workStart) / 1000));
+
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        uint64_t now = traceNow();
+        TRACE_COUNTER("frame time us", (now - lastFrame) / 1000);
+        lastFrame = now;
+
+        // A cursor move is computed once, on the readout thread
+        if (cursorsMoved) {
+            requestReadout();
+            cursorsMoved = false;
+        }
+
+        // Cursor readouts of every channel go to the console once they are ready
+        if (collectReadout()) {
+            for (const std::string& readout : cursorReadouts) {
+                printf("%s\n", readout.c_str());
+            }
+            titleStale = true;
+        }
+
+        // Degradation level, loss counters and the selected channel's cached readout, refreshed once a second
+        if (titleStale || now - lastTitle >= 1000000000ull) {
+            char stats[256], title[600];
+            overloadFormat(stats, sizeof(stats));
+
+            if (!cursorReadouts.empty()) {
+                const std::string& readout = cursorReadouts[readoutChannel % cursorReadouts.size()];
+                snprintf(title, sizeof(title), "Scrolling Data with Autoscaling | %s | %s", stats, readout.c_str());
+            } else {
+                snprintf(title, sizeof(title), "Scrolling Data with Autoscaling | %s", stats);
+            }
+            glfwSetWindowTitle(window, title);
+            lastTitle = now;
+            titleStale = false;
+        }
     }
 
+    {
+        std::lock_guard<std::mutex> lock(readoutMutex);
+        readoutStop = true;
+    }
+    readoutCond.notify_one();
+    readoutThread.join();
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+
     glfwDestroyWindow(window);
     glfwTerminate();
 }
@@ -4,15 +4,24 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "history.h"
+
 #include <cstddef>
 #include <vector>
 
 // Function declarations
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void rescanAmplitudeRange();
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void rescanAmplitudeRange(const HistoryTable& table);
 void push_data(size_t num_vars, ...);
-void drawData(const std::vector<float>& history, size_t head, float offsetY, float aspectRatio, float r, float g, float b);
+void buildVertices(const ChannelRing& history, float minValue, float maxValue, float offsetY, float aspectRatio, size_t columns, std::vector<float>& vertices);
+void drawData(const std::vector<float>& vertices, float r, float g, float b);
+void drawCursors(const ChannelRing& history, float aspectRatio);
+void formatCursorReadout(const ChannelRing& history, size_t channel, uint64_t first, uint64_t last, char* out, size_t size);
+void initPlot();
+void closePlot();
 void startOpenGL();
 
 #endif // PLOT_H
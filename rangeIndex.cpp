@@ -0,0 +1,132 @@
+#include "rangeIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+void RangeSummary::add(float value, uint64_t seq) {
+    if (count == 0 || value < minValue) {
+        minValue = value;
+        minSeq = seq;
+    }
+    if (count == 0 || value > maxValue) {
+        maxValue = value;
+        maxSeq = seq;
+    }
+    sum += value;
+    sumSquares += (double)value * value;
+    count++;
+}
+
+void RangeSummary::add(const float* values, size_t n, uint64_t firstSeq) {
+    for (size_t i = 0; i < n; ++i) {
+        add(values[i], firstSeq + i);
+    }
+}
+
+void RangeSummary::merge(const RangeSummary& other) {
+    if (other.count == 0) {
+        return;
+    }
+    // Ties keep our position, it is the earlier one
+    if (count == 0 || other.minValue < minValue) {
+        minValue = other.minValue;
+        minSeq = other.minSeq;
+    }
+    if (count == 0 || other.maxValue > maxValue) {
+        maxValue = other.maxValue;
+        maxSeq = other.maxSeq;
+    }
+    sum += other.sum;
+    sumSquares += other.sumSquares;
+    count += other.count;
+}
+
+double RangeSummary::rms() const {
+    return count ? std::sqrt(sumSquares / count) : 0.0;
+}
+
+double RangeSummary::stddev() const {
+    if (count == 0) {
+        return 0.0;
+    }
+    double m = mean();
+    // Cancellation can push the variance slightly below zero for near constant signals
+    return std::sqrt(std::max(0.0, sumSquares / count - m * m));
+}
+
+RangeIndex::RangeIndex() : blocks_(0) {
+    for (auto& segment : segments_) {
+        segment.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+RangeIndex::~RangeIndex() {
+    for (auto& segment : segments_) {
+        delete[] segment.load(std::memory_order_relaxed);
+    }
+}
+
+RangeSummary& RangeIndex::writableNode(size_t position) {
+    std::atomic<RangeSummary*>& slot = segments_[position / RANGE_SEGMENT_NODES];
+    RangeSummary* segment = slot.load(std::memory_order_relaxed);
+    if (!segment) {
+        segment = new RangeSummary[RANGE_SEGMENT_NODES];
+        slot.store(segment, std::memory_order_release);
+    }
+    return segment[position % RANGE_SEGMENT_NODES];
+}
+
+bool RangeIndex::append(const float* values, size_t n, uint64_t firstSeq) {
+    size_t leaf = blocks_.load(std::memory_order_relaxed);
+    if (2 * leaf >= (size_t)RANGE_SEGMENT_NODES * RANGE_MAX_SEGMENTS) {
+        return false;
+    }
+
+    RangeSummary& summary = writableNode(2 * leaf);
+    summary = RangeSummary();
+    summary.add(values, n, firstSeq);
+
+    // Every level whose group this leaf completes gets its parent: left child ends
+    // 2^(k - 1) before the parent's position, right child the same distance after it
+    size_t completed = leaf + 1;
+    for (size_t level = 1; (completed & ((size_t(1) << level) - 1)) == 0; ++level) {
+        size_t group = (completed >> level) - 1;
+        size_t position = (group << (level + 1)) + (size_t(1) << level) - 1;
+        size_t half = size_t(1) << (level - 1);
+
+        RangeSummary& parent = writableNode(position);
+        parent = node(position - half);
+        parent.merge(node(position + half));
+    }
+
+    blocks_.store(completed, std::memory_order_release);
+    return true;
+}
+
+RangeSummary RangeIndex::query(size_t first, size_t last) const {
+    RangeSummary left;
+    RangeSummary right;
+
+    // Bottom up: an odd left bound or right bound is a node that sticks out of the
+    // pairs above it, take it and move the bound inwards. Right side nodes are
+    // collected separately so the merge order, and with it the tie breaking, stays left to right.
+    for (size_t level = 0; first < last; ++level) {
+        if (first & 1) {
+            left.merge(node((first << (level + 1)) + (size_t(1) << level) - 1));
+            first++;
+        }
+        if (last & 1) {
+            last--;
+            RangeSummary taken = node((last << (level + 1)) + (size_t(1) << level) - 1);
+            taken.merge(right);
+            right = taken;
+        }
+        first >>= 1;
+        last >>= 1;
+    }
+
+    left.merge(right);
+    return left;
+}
@@ -0,0 +1,72 @@
+#ifndef RANGEINDEX_H
+#define RANGEINDEX_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Nodes per storage segment and number of segments, enough for the leaves and
+// inner nodes of a full ColdStore (COLD_SEGMENT_BLOCKS * COLD_MAX_SEGMENTS blocks)
+#define RANGE_SEGMENT_NODES 4096
+#define RANGE_MAX_SEGMENTS 8192
+
+// Aggregate of a run of samples, positions are sequence numbers
+struct RangeSummary {
+    float minValue;
+    float maxValue;
+    uint64_t minSeq;            // first occurrence of the minimum
+    uint64_t maxSeq;            // first occurrence of the maximum
+    double sum;
+    double sumSquares;
+    uint64_t count;
+
+    RangeSummary()
+        : minValue(std::numeric_limits<float>::max()), maxValue(std::numeric_limits<float>::lowest()),
+          minSeq(0), maxSeq(0), sum(0.0), sumSquares(0.0), count(0) {}
+
+    void add(float value, uint64_t seq);
+    void add(const float* values, size_t n, uint64_t firstSeq);
+
+    // Fold in a summary of a later run of samples
+    void merge(const RangeSummary& other);
+
+    float peakToPeak() const { return count ? maxValue - minValue : 0.0f; }
+    double mean() const { return count ? sum / count : 0.0; }
+    double rms() const;
+    double stddev() const;
+};
+
+// Summaries of an append only sequence of blocks, kept as a binary tree so that any run
+// of whole blocks is answered from at most two nodes per level.
+// Nodes use the in-order layout: leaf i sits at 2 * i and the node covering blocks
+// [j * 2^k, (j + 1) * 2^k) at j * 2^(k + 1) + 2^k - 1, so a parent is complete, and
+// written, as soon as its last leaf is. A single writer appends, readers query the
+// blocks below size() without locking.
+class RangeIndex {
+public:
+    RangeIndex();
+    ~RangeIndex();
+
+    RangeIndex(const RangeIndex&) = delete;
+    RangeIndex& operator=(const RangeIndex&) = delete;
+
+    // Summarize the n samples of the next block, returns false once the index is full
+    bool append(const float* values, size_t n, uint64_t firstSeq);
+
+    size_t size() const { return blocks_.load(std::memory_order_acquire); }
+
+    // Summary of the whole blocks [first, last), O(log size())
+    RangeSummary query(size_t first, size_t last) const;
+
+private:
+    const RangeSummary& node(size_t position) const {
+        return segments_[position / RANGE_SEGMENT_NODES].load(std::memory_order_acquire)[position % RANGE_SEGMENT_NODES];
+    }
+    RangeSummary& writableNode(size_t position);
+
+    std::atomic<RangeSummary*> segments_[RANGE_MAX_SEGMENTS];
+    std::atomic<size_t> blocks_;
+};
+
+#endif // RANGEINDEX_H
@@ -0,0 +1,238 @@
+// Checks RangeIndex::query, ChannelRing::summarize and ChannelRing::crossings against a linear scan of the same samples,
+// and that a ColdStore stays within its byte budget.
+// Build and run with "make rangetest", exits non-zero on the first class of mismatch.
+
+#include "history.h"
+#include "rangeIndex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static RangeSummary linearScan(const std::vector<float>& values, uint64_t first, uint64_t last) {
+    RangeSummary summary;
+    for (uint64_t seq = first; seq < last; ++seq) {
+        summary.add(values[seq], seq);
+    }
+    return summary;
+}
+
+static uint64_t linearCrossings(const std::vector<float>& values, uint64_t first, uint64_t last, float level) {
+    uint64_t crossings = 0;
+    for (uint64_t seq = first + 1; seq < last; ++seq) {
+        crossings += (values[seq - 1] >= level) != (values[seq] >= level);
+    }
+    return crossings;
+}
+
+// Positions and extremes must match exactly, sums only up to the different summation order
+static bool sameSummary(const RangeSummary& got, const RangeSummary& expected) {
+    if (got.count != expected.count) {
+        return false;
+    }
+    if (got.count == 0) {
+        return true;
+    }
+    return got.minValue == expected.minValue && got.maxValue == expected.maxValue &&
+           got.minSeq == expected.minSeq && got.maxSeq == expected.maxSeq &&
+           std::fabs(got.sum - expected.sum) <= 1e-9 * std::max(1.0, std::fabs(expected.sum)) + 1e-6 &&
+           std::fabs(got.sumSquares - expected.sumSquares) <= 1e-9 * expected.sumSquares + 1e-6;
+}
+
+static void printMismatch(const char* what, uint64_t first, uint64_t last, const RangeSummary& got, const RangeSummary& expected) {
+    printf("%s [%llu, %llu): count %llu/%llu min %g@%llu/%g@%llu max %g@%llu/%g@%llu sum %f/%f\n", what,
+           (unsigned long long)first, (unsigned long long)last,
+           (unsigned long long)got.count, (unsigned long long)expected.count,
+           got.minValue, (unsigned long long)got.minSeq, expected.minValue, (unsigned long long)expected.minSeq,
+           got.maxValue, (unsigned long long)got.maxSeq, expected.maxValue, (unsigned long long)expected.maxSeq,
+           got.sum, expected.sum);
+}
+
+// Small integer values so that ties between blocks, and the first-occurrence rule, get exercised
+static long testIndex(std::mt19937& rng) {
+    const size_t blockSize = 16;
+    const size_t blocks = 3000;
+
+    RangeIndex index;
+    std::vector<float> values;
+    for (size_t i = 0; i < blocks; ++i) {
+        float block[blockSize];
+        for (size_t k = 0; k < blockSize; ++k) {
+            block[k] = (float)(rng() % 50);
+            values.push_back(block[k]);
+        }
+        index.append(block, blockSize, i * blockSize);
+    }
+
+    long bad = 0;
+    for (int q = 0; q < 50000; ++q) {
+        size_t first = rng() % (blocks + 1);
+        size_t last = rng() % (blocks + 1);
+        if (first > last) {
+            std::swap(first, last);
+        }
+
+        RangeSummary got = index.query(first, last);
+        RangeSummary expected = linearScan(values, first * blockSize, last * blockSize);
+        if (!sameSummary(got, expected)) {
+            if (bad < 5) {
+                printMismatch("index", first * blockSize, last * blockSize, got, expected);
+            }
+            bad++;
+        }
+    }
+    printf("RangeIndex::query: %ld mismatches\n", bad);
+    return bad;
+}
+
+// An archive over its byte budget refuses further blocks and keeps serving the ones it has
+static long testArchiveBudget(std::mt19937& rng) {
+    const size_t budget = 64 * 1024;
+
+    ColdStore archive(budget);
+    std::normal_distribution<float> noise(0.0f, 1000.0f);
+    float values[HISTORY_BLOCK_SIZE];
+    uint64_t times[HISTORY_BLOCK_SIZE];
+    size_t accepted = 0;
+    size_t refused = 0;
+    size_t largest = 0;
+    for (uint64_t block = 0; block < 1000; ++block) {
+        for (size_t i = 0; i < HISTORY_BLOCK_SIZE; ++i) {
+            values[i] = noise(rng);
+            times[i] = (block * HISTORY_BLOCK_SIZE + i) * 1000;
+        }
+        size_t before = archive.compressedBytes();
+        if (archive.append(values, times, HISTORY_BLOCK_SIZE, accepted * HISTORY_BLOCK_SIZE)) {
+            largest = std::max(largest, archive.compressedBytes() - before);
+            accepted++;
+        } else {
+            refused++;
+        }
+    }
+
+    long bad = 0;
+    if (refused == 0 || archive.size() != accepted || archive.compressedBytes() >= budget + largest) {
+        bad++;
+    }
+    if (archive.find((accepted - 1) * HISTORY_BLOCK_SIZE) != accepted - 1) {
+        bad++;
+    }
+    printf("ColdStore budget: %zu blocks in %zu of %zu bytes, %zu refused, %ld failures\n", accepted,
+           archive.compressedBytes(), budget, refused, bad);
+    return bad;
+}
+
+// Pushes through the history while the resizer grows and shrinks it, then queries the ring
+static long testRing(std::mt19937& rng) {
+    const uint64_t samples = 3000000;
+
+    historyInit(1, 1000);
+    // Let the resizer thread pick up the initial capacity before requesting others
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::vector<float> values;
+    std::normal_distribution<float> noise(0.0f, 1000.0f);
+    for (uint64_t seq = 0; seq < samples; ++seq) {
+        if (seq % 200000 == 0) {
+            historyRequestCapacity(10 + rng() % 9000);
+        }
+        float value = noise(rng);
+        values.push_back(value);
+
+        HistoryTable& table = historyBeginWrite(1);
+        table.rings[0]->push(value, seq * 10 + 5);
+        historyEndWrite();
+    }
+
+    long bad = 0;
+    long badTimes = 0;
+    {
+        HistoryReadGuard guard;
+        const ChannelRing& ring = *guard.table().rings[0];
+
+        for (int q = 0; q < 600; ++q) {
+            uint64_t first = rng() % (samples + 1);
+            uint64_t last = rng() % (samples + 1);
+            if (first > last) {
+                std::swap(first, last);
+            }
+            // Every third query reaches into the open block
+            if (q % 3 == 0) {
+                last = samples;
+            }
+
+            RangeSummary got = ring.summarize(first, last);
+            RangeSummary expected = linearScan(values, first, last);
+            if (!sameSummary(got, expected)) {
+                if (bad < 5) {
+                    printMismatch("ring", first, last, got, expected);
+                }
+                bad++;
+            }
+
+            if (q % 10 == 0 && ring.crossings(first, last, 100.0f) != linearCrossings(values, first, last, 100.0f)) {
+                if (bad < 5) {
+                    printf("crossings [%llu, %llu) differ\n", (unsigned long long)first, (unsigned long long)last);
+                }
+                bad++;
+            }
+
+            uint64_t seq = rng() % samples;
+            if (ring.timeOf(seq) != seq * 10 + 5) {
+                badTimes++;
+            }
+        }
+
+        // Noise never fits a 16-bit encoding, AUTO must keep it in the wide payload alone
+        if (ring.narrow.load() != nullptr || ring.recentSampleBytes() != sizeof(float)) {
+            printf("AUTO ring of float data holds %zu bytes per sample\n", ring.sampleBytes());
+            bad++;
+        }
+
+        // The newest window must read back what was pushed, whatever capacity the resizes left
+        size_t window = std::min<size_t>(guard.table().capacity, samples);
+        std::vector<float> shown(window);
+        ring.readWindow(samples, 0, window, shown.data());
+        for (size_t i = 0; i < window; ++i) {
+            if (shown[i] != values[samples - window + i]) {
+                bad++;
+                break;
+            }
+        }
+    }
+
+    // Reader slots of exited threads are reused, far more short lived readers than slots must all get in
+    long readers = 0;
+    for (int i = 0; i < 500; ++i) {
+        std::thread reader([&readers] {
+            HistoryReadGuard guard;
+            readers += guard.table().capacity > 0;
+        });
+        reader.join();
+    }
+    if (readers != 500) {
+        printf("%ld of 500 short lived readers saw a table\n", readers);
+        bad++;
+    }
+    historyShutdown();
+
+    printf("ChannelRing::summarize and crossings: %ld mismatches, %ld wrong timestamps\n", bad, badTimes);
+    return bad + badTimes;
+}
+
+int main() {
+    std::mt19937 rng(7);
+
+    long bad = testIndex(rng);
+    bad += testArchiveBudget(rng);
+    bad += testRing(rng);
+
+    printf(bad ? "FAILED\n" : "OK\n");
+    return bad ? 1 : 0;
+}
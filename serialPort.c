@@ -20,15 +20,57 @@
 
 #include <stdio.h>
 #include "serialPort.h"
+#include "trace.h"
 #include <windows.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 #define FILE_NO_SHARED_ACCESS   0
 #define FILE_RW_MODE            (FILE_GENERIC_READ | FILE_GENERIC_WRITE)
 
 DWORD WINAPI MonitorSerialRX(LPVOID lpParam);
-static char input_buf[4096];    
+static DWORD WINAPI serialTxThread(LPVOID lpParam);
+static char input_buf[SERIAL_RX_CHUNK];
+
+/* Transmit queue of a port, allocated by the first serialTxStart and kept until the port is closed */
+struct serial_tx_s {
+    serial_port_t* port;
+    HANDLE thread;
+    HANDLE wake;                /* auto reset: new data, new stream or stop */
+    HANDLE writeDone;           /* manual reset completion event of the write in flight */
+    CRITICAL_SECTION lock;      /* guards the queue, the stream settings and the stats */
+    volatile LONG running;
+
+    uint8_t queue[SERIAL_TX_QUEUE_SIZE];
+    uint32_t head;              /* oldest queued byte */
+    uint32_t count;             /* bytes queued */
+
+    /* The write in flight is copied out of the queue so that the queue keeps accepting data */
+    OVERLAPPED ov;
+    uint8_t inflight[SERIAL_TX_WRITE_MAX];
+    uint32_t inflightBytes;
+    BOOL pending;
+    uint8_t scratch[SERIAL_TX_WRITE_MAX];   /* stream data on its way from the source to the queue */
+    uint32_t scratchBytes;      /* stream bytes the queue had no room for yet, queued before anything else the stream produces */
+
+    serial_tx_source_t source;
+    void* sourceContext;
+    uint32_t leadMs;
+    BOOL restart;               /* stream settings changed, picked up by the transmit thread */
+
+    serial_tx_stats_t stats;
+};
+
+
+/* Wait for an overlapped operation that was just started; ok is what the starting call returned */
+static BOOL finishOverlapped(HANDLE handle, BOOL ok, OVERLAPPED* ov, DWORD* transferred)
+{
+    if (!ok && GetLastError() != ERROR_IO_PENDING)
+        return FALSE;
+    return GetOverlappedResult(handle, ov, transferred, TRUE);
+}
 
 
 serial_port_err_t setTimeouts(serial_port_t* port, uint64_t readTimeout, uint64_t writeTimeout)
@@ -93,9 +135,12 @@ serial_port_err_t serialPortOpen(serial_port_t* port, const char* name, uint64_t
     port->isOpen = FALSE;
     port->readTimeout = readTimeout;
     port->writeTimeout = writeTimeout;
+    port->rxOverruns = 0;
+    port->rxReadErrors = 0;
+    port->tx = NULL;
     
-    /* open the serial port by opening it as a file with the following attributes */
-    port->handle = CreateFileA(port->name, FILE_RW_MODE, FILE_NO_SHARED_ACCESS, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    /* open the serial port by opening it as a file with the following attributes, overlapped so reads and writes can run concurrently */
+    port->handle = CreateFileA(port->name, FILE_RW_MODE, FILE_NO_SHARED_ACCESS, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
 
     /* set the baud rate and the timeouts */
     setBaud(port, baud);
@@ -107,6 +152,10 @@ serial_port_err_t serialPortOpen(serial_port_t* port, const char* name, uint64_t
         return SERIAL_ERR_OPEN;
     }
 
+    /* manual reset completion events for the overlapped operations */
+    port->waitEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    port->readEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
     /* set the port is open to TRUE */
     port->isOpen = TRUE;
 
@@ -119,10 +168,23 @@ serial_port_err_t serialPortOpen(serial_port_t* port, const char* name, uint64_t
 
 serial_port_err_t serialPortClose(serial_port_t* port)
 {
+    /* the transmit thread must be gone before the handle it writes to */
+    serialTxStop(port);
+    if (port->tx)
+    {
+        DeleteCriticalSection(&port->tx->lock);
+        CloseHandle(port->tx->wake);
+        CloseHandle(port->tx->writeDone);
+        free(port->tx);
+        port->tx = NULL;
+    }
+
     /* Close the port handle and set the isOpen to FALSE upon success*/
     if (CloseHandle(port->handle))
     {
         port->isOpen = FALSE;
+        CloseHandle(port->waitEvent);
+        CloseHandle(port->readEvent);
         /* return OK */
         return SERIAL_ERR_OK;
     }
@@ -134,13 +196,22 @@ serial_port_err_t serialPortClose(serial_port_t* port)
 }
 
 
+/* Overlapped read of up to size bytes, the read timeouts still apply; bytesRead is what actually arrived */
+static BOOL readOverlapped(serial_port_t* port, char *buf, uint64_t size, DWORD* bytesRead)
+{
+    OVERLAPPED ov = {0};
+    ov.hEvent = port->readEvent;
+    *bytesRead = 0;
+    return finishOverlapped(port->handle, ReadFile(port->handle, buf, (DWORD)size, NULL, &ov), &ov, bytesRead);
+}
+
 serial_port_err_t serialPortRead(serial_port_t* port, char *buf, uint64_t size)
 {
     /* to store the actual bytes read */
-    uint64_t bytesRead;
+    DWORD bytesRead = 0;
 
     /* read from the serial port and check if it's a successful read */
-    if(ReadFile(port->handle, buf, size, (LPDWORD)&bytesRead, NULL) != TRUE)
+    if(!readOverlapped(port, buf, size, &bytesRead))
     {
         
         return SERIAL_ERR_READ_UNKNOWN;
@@ -158,10 +229,18 @@ serial_port_err_t serialPortRead(serial_port_t* port, char *buf, uint64_t size)
 serial_port_err_t serialPortWrite(serial_port_t* port, uint8_t *buf, uint64_t size)
 {
     /* to store the actual bytes written */
-    uint64_t bytesWrite;
+    DWORD bytesWrite = 0;
+    OVERLAPPED ov = {0};
+
+    /* an event per call, a shared one could be reset or signalled by a concurrent writer */
+    ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if(ov.hEvent == NULL)
+        return SERIAL_ERR_WRITE_UNKNOWN;
 
     /* write to the serial port and check if it's a successful write */
-    if(WriteFile(port->handle, buf, size, (LPDWORD)&bytesWrite, NULL) != TRUE)
+    BOOL ok = finishOverlapped(port->handle, WriteFile(port->handle, buf, (DWORD)size, NULL, &ov), &ov, &bytesWrite);
+    CloseHandle(ov.hEvent);
+    if(!ok)
     {
         
         return SERIAL_ERR_WRITE_UNKNOWN;
@@ -182,6 +261,10 @@ int bytesAvailable(serial_port_t *hSerial) {
 
     // Clear any communication errors and get the current status of the serial port
     if (ClearCommError(hSerial->handle, &errors, &comStat)) {
+        // Bytes were lost either in the UART or in the driver queue
+        if (errors & (CE_OVERRUN | CE_RXOVER))
+            hSerial->rxOverruns++;
+
         // Return the number of bytes available in the input buffer
         return comStat.cbInQue;
     } else {
@@ -192,13 +275,17 @@ int bytesAvailable(serial_port_t *hSerial) {
 
 
 int isDataAvailable(serial_port_t *hSerial) {
-    DWORD eventMask;
+    DWORD eventMask = 0;
+    DWORD transferred;
+    OVERLAPPED ov = {0};
+    ov.hEvent = hSerial->waitEvent;
+
     if (!SetCommMask(hSerial->handle, EV_RXCHAR)) {
         return -1;
     }
 
-    // Wait for an event to occur (like receiving a character)
-    if (WaitCommEvent(hSerial->handle, &eventMask, NULL)) {
+    // Wait for an event to occur (like receiving a character), overlapped so writes are not held up meanwhile
+    if (finishOverlapped(hSerial->handle, WaitCommEvent(hSerial->handle, &eventMask, &ov), &ov, &transferred)) {
         if (eventMask & EV_RXCHAR) {
             return 1;
         }
@@ -236,16 +323,458 @@ DWORD WINAPI MonitorSerialRX(LPVOID lpParam) {
 
     serial_port_t *serial = (serial_port_t*)(lpParam);
 
+    traceSetThreadName("serial rx");
+
     while (1)
     {
         // blocking event until a new character is received and this does not load the CPU :)
         isDataAvailable(serial);
+
         int bytes = bytesAvailable(serial);
-        serialPortRead(serial, input_buf, bytes);
 
-        // Call the event Handler function and pass the received bytes
-        serial->serialEventHandler(input_buf, bytes);
+        // Hand the backlog over in chunks that fit input_buf
+        while (bytes > 0)
+        {
+            int chunk = bytes < (int)sizeof(input_buf) ? bytes : (int)sizeof(input_buf);
+
+            DWORD got = 0;
+            uint64_t traceStart = TRACE_BEGIN();
+            BOOL ok = readOverlapped(serial, input_buf, chunk, &got);
+            TRACE_END("MonitorSerialRX read", traceStart);
+
+            if (traceStart) {
+                traceCounter("rx bytes per read", got);
+                traceCounter("rx queue after read", bytesAvailable(serial));
+            }
+
+            // A failed read loses whatever it took from the driver, count it so the overload stats show it
+            if (!ok)
+            {
+                serial->rxReadErrors++;
+                break;
+            }
+
+            // Call the event Handler function and pass the received bytes, a short read still hands over what arrived
+            if (got > 0)
+                serial->serialEventHandler(input_buf, (int)got);
+            if (got < (DWORD)chunk)
+                break;
+            bytes -= chunk;
+        }
     }
     
     return 0;
-}
\ No newline at end of file
+}
+
+/* Seconds on the performance counter */
+static double txSeconds(LARGE_INTEGER frequency)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+
+/* Append size bytes to the queue, the caller holds the lock and has checked the room */
+static void txQueuePut(struct serial_tx_s* tx, const uint8_t* buf, uint32_t size)
+{
+    uint32_t tail = (tx->head + tx->count) % SERIAL_TX_QUEUE_SIZE;
+    uint32_t first = size < SERIAL_TX_QUEUE_SIZE - tail ? size : SERIAL_TX_QUEUE_SIZE - tail;
+
+    memcpy(tx->queue + tail, buf, first);
+    memcpy(tx->queue, buf + first, size - first);
+    tx->count += size;
+}
+
+
+/* Queue size bytes if they fit, all or nothing */
+static serial_port_err_t txQueueOffer(struct serial_tx_s* tx, const uint8_t* buf, uint32_t size)
+{
+    serial_port_err_t err = SERIAL_ERR_OK;
+
+    EnterCriticalSection(&tx->lock);
+    if (size > SERIAL_TX_QUEUE_SIZE - tx->count)
+    {
+        tx->stats.bytesRejected += size;
+        err = SERIAL_ERR_TX_FULL;
+    }
+    else
+    {
+        txQueuePut(tx, buf, size);
+        tx->stats.bytesQueued += size;
+        tx->stats.enqueues++;
+    }
+    LeaveCriticalSection(&tx->lock);
+
+    return err;
+}
+
+
+/* Top up the pending write with queued bytes and hand it to the driver */
+static void txStartWrite(struct serial_tx_s* tx)
+{
+    /* everything that piled up since the last write goes out together */
+    EnterCriticalSection(&tx->lock);
+    while (tx->count > 0 && tx->inflightBytes < SERIAL_TX_WRITE_MAX)
+    {
+        uint32_t n = SERIAL_TX_WRITE_MAX - tx->inflightBytes;
+        if (n > tx->count)
+            n = tx->count;
+        if (n > SERIAL_TX_QUEUE_SIZE - tx->head)
+            n = SERIAL_TX_QUEUE_SIZE - tx->head;
+
+        memcpy(tx->inflight + tx->inflightBytes, tx->queue + tx->head, n);
+        tx->inflightBytes += n;
+        tx->head = (tx->head + n) % SERIAL_TX_QUEUE_SIZE;
+        tx->count -= n;
+    }
+    LeaveCriticalSection(&tx->lock);
+
+    if (tx->inflightBytes == 0)
+        return;
+
+    memset(&tx->ov, 0, sizeof(tx->ov));
+    tx->ov.hEvent = tx->writeDone;
+
+    /* a write that completes right away still signals writeDone, it is reaped like a pending one */
+    if (!WriteFile(tx->port->handle, tx->inflight, tx->inflightBytes, NULL, &tx->ov) && GetLastError() != ERROR_IO_PENDING)
+    {
+        EnterCriticalSection(&tx->lock);
+        tx->stats.writeErrors++;
+        tx->inflightBytes = 0;
+        LeaveCriticalSection(&tx->lock);
+        return;
+    }
+
+    if (traceIsActive())
+        traceCounter("tx bytes per write", tx->inflightBytes);
+
+    tx->pending = TRUE;
+    EnterCriticalSection(&tx->lock);
+    tx->stats.writes++;
+    LeaveCriticalSection(&tx->lock);
+}
+
+
+/* Account for the completed write, a write cut short by the timeout keeps its remainder for the next one */
+static void txCompleteWrite(struct serial_tx_s* tx)
+{
+    DWORD sent = 0;
+    BOOL ok = GetOverlappedResult(tx->port->handle, &tx->ov, &sent, FALSE);
+    tx->pending = FALSE;
+
+    EnterCriticalSection(&tx->lock);
+    if (!ok)
+    {
+        tx->stats.writeErrors++;
+        tx->inflightBytes = 0;
+    }
+    else
+    {
+        tx->stats.bytesSent += sent;
+        if (sent < tx->inflightBytes)
+        {
+            tx->stats.writeTimeouts++;
+            memmove(tx->inflight, tx->inflight + sent, tx->inflightBytes - sent);
+        }
+        tx->inflightBytes -= sent;
+    }
+    LeaveCriticalSection(&tx->lock);
+}
+
+
+/* Queue the stream bytes waiting in scratch, returns FALSE if there is still no room for them */
+static BOOL txQueueScratch(struct serial_tx_s* tx)
+{
+    EnterCriticalSection(&tx->lock);
+    BOOL fits = tx->scratchBytes <= SERIAL_TX_QUEUE_SIZE - tx->count;
+    if (fits && tx->scratchBytes > 0)
+    {
+        txQueuePut(tx, tx->scratch, tx->scratchBytes);
+        tx->stats.bytesQueued += tx->scratchBytes;
+        tx->stats.enqueues++;
+        tx->scratchBytes = 0;
+    }
+    LeaveCriticalSection(&tx->lock);
+
+    return fits;
+}
+
+
+/* Pull everything due up to stream time until from the source, returns FALSE once it is exhausted */
+static BOOL txPumpStream(struct serial_tx_s* tx, serial_tx_source_t source, void* context, double until)
+{
+    /* the source has moved past these bytes already, they go first and nothing new until they are in */
+    while (txQueueScratch(tx))
+    {
+        EnterCriticalSection(&tx->lock);
+        uint32_t room = SERIAL_TX_QUEUE_SIZE - tx->count;
+        LeaveCriticalSection(&tx->lock);
+
+        /* a full queue just means the line is slower than the stream, the rest follows next tick */
+        if (room == 0)
+            return TRUE;
+
+        /* serialTxEnqueue may take the room meanwhile, then the bytes wait in scratch for the next tick */
+        int n = source(context, tx->scratch, room < sizeof(tx->scratch) ? room : (uint32_t)sizeof(tx->scratch), until);
+        if (n < 0)
+            return FALSE;
+        if (n == 0)
+            return TRUE;
+        tx->scratchBytes = (uint32_t)n;
+    }
+    return TRUE;
+}
+
+
+static DWORD WINAPI serialTxThread(LPVOID lpParam)
+{
+    struct serial_tx_s* tx = (struct serial_tx_s*)lpParam;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    /* stream state, private to this thread */
+    serial_tx_source_t source = NULL;
+    void* context = NULL;
+    double lead = 0.0;
+    double period = 0.0;
+    double streamStart = 0.0;
+    double nextTick = 0.0;
+    double lastPump = 0.0;
+    double jitterSum = 0.0;
+    uint64_t ticks = 0;
+
+    double windowStart = txSeconds(frequency);
+    uint64_t windowBytes = 0;
+    BOOL fineTimer = FALSE;     /* holding a timeBeginPeriod(1) request */
+
+    traceSetThreadName("serial tx");
+
+    while (tx->running)
+    {
+        double now = txSeconds(frequency);
+
+        /* pick up a new or stopped stream */
+        EnterCriticalSection(&tx->lock);
+        if (tx->restart)
+        {
+            source = tx->source;
+            context = tx->sourceContext;
+            lead = tx->leadMs / 1000.0;
+            period = lead / 4.0;
+            if (period < SERIAL_TX_TICK_MIN_MS / 1000.0)
+                period = SERIAL_TX_TICK_MIN_MS / 1000.0;
+            if (period > SERIAL_TX_TICK_MAX_MS / 1000.0)
+                period = SERIAL_TX_TICK_MAX_MS / 1000.0;
+            streamStart = nextTick = lastPump = now;
+            tx->restart = FALSE;
+        }
+        LeaveCriticalSection(&tx->lock);
+
+        if (source && now >= nextTick)
+        {
+            uint64_t traceStart = TRACE_BEGIN();
+
+            /* how late the tick is against its schedule, and whether the lead ran dry since the last one */
+            double late = now - nextTick;
+            BOOL underrun = now - lastPump > lead;
+
+            if (!txPumpStream(tx, source, context, now - streamStart + lead))
+                source = NULL;
+            lastPump = now;
+
+            nextTick += period;
+            if (nextTick < now)
+                nextTick = now + period;
+
+            EnterCriticalSection(&tx->lock);
+            ticks++;
+            jitterSum += late;
+            tx->stats.jitterMeanUs = jitterSum / ticks * 1e6;
+            if (late * 1e6 > tx->stats.jitterMaxUs)
+                tx->stats.jitterMaxUs = late * 1e6;
+            if (underrun)
+                tx->stats.underruns++;
+            if (!source && !tx->restart)
+                tx->source = NULL;
+            LeaveCriticalSection(&tx->lock);
+
+            TRACE_END("serial tx pump", traceStart);
+            if (traceStart)
+                traceCounter("tx tick late us", (int64_t)(late * 1e6));
+        }
+
+        /* a stopped or replaced stream still delivers what its source already produced */
+        if (!source && tx->scratchBytes > 0)
+            txQueueScratch(tx);
+
+        if (!tx->pending)
+            txStartWrite(tx);
+
+        /* waits round up to the timer resolution, ~15.6 ms by default, far coarser than short ticks */
+        if ((source != NULL) != fineTimer)
+        {
+            if (source)
+                timeBeginPeriod(1);
+            else
+                timeEndPeriod(1);
+            fineTimer = !fineTimer;
+        }
+
+        /* sleep until the next tick, new data or the end of the write in flight */
+        DWORD timeout = INFINITE;
+        if (source)
+        {
+            double wait = nextTick - txSeconds(frequency);
+            timeout = wait > 0.0 ? (DWORD)(wait * 1000.0 + 0.999) : 0;
+        }
+        else if (tx->scratchBytes > 0)
+        {
+            /* retry the leftover stream bytes once the write in flight made room */
+            timeout = SERIAL_TX_TICK_MAX_MS;
+        }
+        else
+        {
+            /* keep the throughput window rolling while idle */
+            timeout = 1000;
+        }
+
+        HANDLE events[2] = { tx->wake, tx->writeDone };
+        DWORD result = WaitForMultipleObjects(tx->pending ? 2 : 1, events, FALSE, timeout);
+        if (result == WAIT_OBJECT_0 + 1)
+            txCompleteWrite(tx);
+
+        now = txSeconds(frequency);
+        if (now - windowStart >= 1.0)
+        {
+            EnterCriticalSection(&tx->lock);
+            tx->stats.throughput = (tx->stats.bytesSent - windowBytes) / (now - windowStart);
+            windowBytes = tx->stats.bytesSent;
+            LeaveCriticalSection(&tx->lock);
+            windowStart = now;
+        }
+    }
+
+    if (fineTimer)
+        timeEndPeriod(1);
+
+    /* don't leave a write referencing inflight behind */
+    if (tx->pending)
+    {
+        DWORD sent;
+        CancelIoEx(tx->port->handle, &tx->ov);
+        GetOverlappedResult(tx->port->handle, &tx->ov, &sent, TRUE);
+        tx->pending = FALSE;
+    }
+
+    return 0;
+}
+
+
+serial_port_err_t serialTxStart(serial_port_t* port)
+{
+    struct serial_tx_s* tx = port->tx;
+
+    if (tx && tx->running)
+        return SERIAL_ERR_OK;
+
+    if (!tx)
+    {
+        tx = (struct serial_tx_s*)calloc(1, sizeof(struct serial_tx_s));
+        if (!tx)
+            return SERIAL_ERR_UNKNOWN;
+
+        tx->port = port;
+        tx->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+        tx->writeDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+        InitializeCriticalSection(&tx->lock);
+        port->tx = tx;
+    }
+
+    tx->running = 1;
+    tx->thread = CreateThread(NULL, 0, serialTxThread, tx, 0, NULL);
+    if (tx->thread == NULL)
+    {
+        tx->running = 0;
+        return SERIAL_ERR_UNKNOWN;
+    }
+
+    return SERIAL_ERR_OK;
+}
+
+
+void serialTxStop(serial_port_t* port)
+{
+    struct serial_tx_s* tx = port->tx;
+
+    if (!tx || !tx->running)
+        return;
+
+    InterlockedExchange(&tx->running, 0);
+    SetEvent(tx->wake);
+    WaitForSingleObject(tx->thread, INFINITE);
+    CloseHandle(tx->thread);
+    tx->thread = NULL;
+
+    /* the stats survive, the data does not */
+    EnterCriticalSection(&tx->lock);
+    tx->head = 0;
+    tx->count = 0;
+    tx->inflightBytes = 0;
+    tx->scratchBytes = 0;
+    tx->source = NULL;
+    tx->restart = TRUE;
+    LeaveCriticalSection(&tx->lock);
+}
+
+
+serial_port_err_t serialTxEnqueue(serial_port_t* port, const uint8_t* buf, uint32_t size)
+{
+    struct serial_tx_s* tx = port->tx;
+
+    if (!tx || !tx->running)
+        return SERIAL_ERR_TX_NOT_STARTED;
+
+    serial_port_err_t err = txQueueOffer(tx, buf, size);
+    if (err == SERIAL_ERR_OK)
+        SetEvent(tx->wake);
+
+    return err;
+}
+
+
+serial_port_err_t serialTxStream(serial_port_t* port, serial_tx_source_t source, void* context, uint32_t leadMs)
+{
+    struct serial_tx_s* tx = port->tx;
+
+    if (!tx || !tx->running)
+        return SERIAL_ERR_TX_NOT_STARTED;
+
+    EnterCriticalSection(&tx->lock);
+    tx->source = source;
+    tx->sourceContext = context;
+    tx->leadMs = leadMs;
+    tx->restart = TRUE;
+    LeaveCriticalSection(&tx->lock);
+    SetEvent(tx->wake);
+
+    return SERIAL_ERR_OK;
+}
+
+
+void serialTxGetStats(serial_port_t* port, serial_tx_stats_t* stats)
+{
+    struct serial_tx_s* tx = port->tx;
+
+    if (!tx)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    EnterCriticalSection(&tx->lock);
+    *stats = tx->stats;
+    stats->queued = tx->count + tx->inflightBytes;
+    LeaveCriticalSection(&tx->lock);
+}
@@ -18,6 +18,21 @@
 #include <stdint.h>
 #include <windows.h>
 
+/** Largest number of bytes handed to the event handler in one call. */
+#define SERIAL_RX_CHUNK 4096
+
+/** Bytes the transmit queue can hold before serialTxEnqueue refuses more. */
+#define SERIAL_TX_QUEUE_SIZE 65536
+
+/** Largest single write; queued bytes up to this size go out in one WriteFile call. */
+#define SERIAL_TX_WRITE_MAX 4096
+
+/** Bounds of the stream pacing period, which is a quarter of the lead buffer.
+ *  Ticks below the default ~15.6 ms timer resolution rely on the timeBeginPeriod(1) request
+ *  the transmit thread holds while a stream runs. */
+#define SERIAL_TX_TICK_MIN_MS 1
+#define SERIAL_TX_TICK_MAX_MS 20
+
 /**
  * @defgroup structs Structures
  * @brief Structures used for serial port communication.
@@ -52,9 +67,46 @@ typedef struct {
     uint64_t baud;          /**< Baud rate of the port. */
     uint32_t readTimeout;   /**< Read timeout in milliseconds. */
     uint32_t writeTimeout;  /**< Write timeout in milliseconds. */
+    volatile uint32_t rxOverruns; /**< Receive overruns reported by the driver since the port was opened. */
+    volatile uint32_t rxReadErrors; /**< Failed receive reads since the port was opened, the bytes they took are lost. */
+    HANDLE waitEvent;       /**< Completion event of the overlapped WaitCommEvent. */
+    HANDLE readEvent;       /**< Completion event of overlapped reads. */
+    struct serial_tx_s *tx; /**< Asynchronous transmit queue, NULL until serialTxStart. */
     void (*serialEventHandler)(char*, int); /**< Callback for received data events. */
 } serial_port_t;
 
+/**
+ * @brief Produces stimulus data for serialTxStream.
+ *
+ * Called from the transmit thread. The source writes the bytes that are due up to stream time
+ * @p until (seconds since the stream started) into @p buf, at most @p size of them, and is
+ * called again until it returns 0 or the queue is full.
+ *
+ * @return Number of bytes written, 0 if nothing more is due yet, or -1 once the source is exhausted.
+ */
+typedef int (*serial_tx_source_t)(void* context, uint8_t* buf, uint32_t size, double until);
+
+/**
+ * @struct serial_tx_stats_t
+ * @brief Transmit queue counters, see serialTxGetStats.
+ *
+ * @ingroup structs
+ */
+typedef struct {
+    uint64_t bytesQueued;   /**< Bytes accepted by serialTxEnqueue and the stream. */
+    uint64_t bytesRejected; /**< Bytes refused because the queue was full. */
+    uint64_t bytesSent;     /**< Bytes the driver has completed. */
+    uint64_t enqueues;      /**< Accepted serialTxEnqueue calls and stream fills. */
+    uint64_t writes;        /**< WriteFile calls, fewer than enqueues when small writes were coalesced. */
+    uint64_t writeTimeouts; /**< Writes cut short by the write timeout, the rest is sent again. */
+    uint64_t writeErrors;   /**< Failed writes, their bytes are lost. */
+    uint64_t underruns;     /**< Stream ticks that came later than the lead buffer reaches. */
+    uint32_t queued;        /**< Bytes currently waiting in the queue. */
+    double throughput;      /**< Bytes per second sent over the last full second. */
+    double jitterMeanUs;    /**< Mean lateness of the stream ticks in microseconds. */
+    double jitterMaxUs;     /**< Worst lateness of a stream tick in microseconds. */
+} serial_tx_stats_t;
+
 /**
  * @enum serial_port_err_t
  * @brief Error codes for serial port operations.
@@ -69,12 +121,17 @@ typedef enum {
     SERIAL_ERR_READ_UNKNOWN,       /**< Unknown error during read operation. */
     SERIAL_ERR_READ_SIZE_MISMATCH, /**< Bytes read do not match expected size. */
     SERIAL_ERR_WRITE_UNKNOWN,      /**< Unknown error during write operation. */
-    SERIAL_ERR_WRITE_SIZE_MISMATCH /**< Bytes written do not match buffer size. */
+    SERIAL_ERR_WRITE_SIZE_MISMATCH, /**< Bytes written do not match buffer size. */
+    SERIAL_ERR_TX_NOT_STARTED,     /**< The transmit queue is not running. */
+    SERIAL_ERR_TX_FULL             /**< Not enough room in the transmit queue. */
 } serial_port_err_t;
 
 /**
  * @brief Opens a serial port and initializes the handle.
  *
+ * The port is opened for overlapped I/O, so the receive thread, the transmit thread and
+ * blocking calls from other threads do not serialize on the handle.
+ *
  * @param[in] port Pointer to the serial port structure.
  * @param[in] name String containing the name of the serial port.
  * @param[in] baud Baud rate for the serial port.
@@ -114,6 +171,9 @@ serial_port_err_t serialPortRead(serial_port_t* port, char *buf, uint64_t size);
 /**
  * @brief Writes data to the serial port.
  * 
+ * Blocks until the driver has taken the data; use serialTxEnqueue from threads that must not wait.
+ * Safe to call from several threads at once, each call waits on an event of its own.
+ * 
  * @param[in] port Pointer to the serial port structure.
  * @param[in] buf Buffer containing the data to write.
  * @param[in] size Size of the data in the buffer.
@@ -153,6 +213,8 @@ serial_port_err_t setTimeouts(serial_port_t* port, uint64_t readTimeout, uint64_
 /**
  * @brief Returns the number of bytes available to read from the serial port.
  * 
+ * Clears pending communication errors; receive overruns among them are added to rxOverruns.
+ * 
  * @param[in] hSerial Pointer to a serial_port_t structure.
  * 
  * @return Number of bytes available, or -1 if an error occurred.
@@ -174,6 +236,7 @@ int bytesAvailable(serial_port_t *hSerial);
  *                          **`void event_handler(char* buffer, int bytes);`**
  *                          - `buffer` contains the data received from the serial port.
  *                          - `bytes` is the number of bytes in the buffer.
+ *                          Larger backlogs are delivered in several calls of at most SERIAL_RX_CHUNK bytes.
  * 
  * @return 0 if successful, otherwise -1 if an event handler is already registered or on error.
  * 
@@ -181,4 +244,72 @@ int bytesAvailable(serial_port_t *hSerial);
  */
 int enableSerialEvent(serial_port_t *hSerial, void (*event_handler)(char* buffer, int bytes));
 
+/**
+ * @brief Starts the asynchronous transmit queue of a port.
+ *
+ * A dedicated thread drains the queue with one overlapped write at a time. Bytes that are
+ * enqueued while a write is in flight are coalesced into the next one.
+ *
+ * @param[in] port Pointer to an open serial port.
+ *
+ * @return SERIAL_ERR_OK if successful, otherwise SERIAL_ERR_UNKNOWN.
+ *
+ * @ingroup HL_functions
+ */
+serial_port_err_t serialTxStart(serial_port_t* port);
+
+/**
+ * @brief Stops the transmit thread, cancelling the write in flight and discarding the queue.
+ *
+ * @param[in] port Pointer to the serial port structure.
+ *
+ * @ingroup HL_functions
+ */
+void serialTxStop(serial_port_t* port);
+
+/**
+ * @brief Queues bytes for transmission without blocking.
+ *
+ * Either all bytes are queued or none. Safe to call from any thread, including the receive callback.
+ *
+ * @param[in] port Pointer to the serial port structure.
+ * @param[in] buf Data to send.
+ * @param[in] size Number of bytes in buf.
+ *
+ * @return SERIAL_ERR_OK, SERIAL_ERR_TX_FULL if the queue has no room, or SERIAL_ERR_TX_NOT_STARTED.
+ *
+ * @ingroup HL_functions
+ */
+serial_port_err_t serialTxEnqueue(serial_port_t* port, const uint8_t* buf, uint32_t size);
+
+/**
+ * @brief Streams data from a source at its own pace.
+ *
+ * The transmit thread ticks every quarter of the lead buffer and asks the source for everything
+ * due up to @p leadMs ahead of real time, so scheduling delays shorter than the lead do not
+ * starve the device. A larger lead tolerates more jitter at the cost of latency. Replaces any
+ * stream already running; a NULL source stops streaming. While a stream runs the system timer
+ * resolution is raised to 1 ms, so leads down to a few milliseconds pace correctly.
+ *
+ * @param[in] port Pointer to the serial port structure.
+ * @param[in] source Callback producing the data.
+ * @param[in] context Passed to the source unchanged.
+ * @param[in] leadMs How far ahead of real time data is handed to the driver.
+ *
+ * @return SERIAL_ERR_OK or SERIAL_ERR_TX_NOT_STARTED.
+ *
+ * @ingroup HL_functions
+ */
+serial_port_err_t serialTxStream(serial_port_t* port, serial_tx_source_t source, void* context, uint32_t leadMs);
+
+/**
+ * @brief Copies the transmit queue counters.
+ *
+ * @param[in] port Pointer to the serial port structure.
+ * @param[out] stats Receives the counters, zeroed if the queue was never started.
+ *
+ * @ingroup HL_functions
+ */
+void serialTxGetStats(serial_port_t* port, serial_tx_stats_t* stats);
+
 #endif
@@ -0,0 +1,19 @@
+/*
+ * Hooks into the simulated UART and timer of the Win32 shim, for tests only.
+ */
+
+#ifndef SHIM_UARTSIM_H
+#define SHIM_UARTSIM_H
+
+#include <string>
+
+// Everything the simulated device has received so far
+std::string uartSimReceived();
+
+// Line speed of the simulated port, 10 bit times per byte. Defaults to the rate passed to SetCommState.
+void uartSimSetBaud(double baud);
+
+// Number of timeBeginPeriod calls not yet matched by timeEndPeriod
+int uartSimTimerRequests();
+
+#endif // SHIM_UARTSIM_H
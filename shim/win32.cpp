@@ -0,0 +1,273 @@
+// POSIX implementation of the Win32 subset in shim/windows.h.
+//
+// Events are flags under one global mutex, so WaitForMultipleObjects can wait on any of them.
+// Writes to the port complete after the time the simulated UART needs to shift the bytes out,
+// and land in a buffer the test can inspect. Finite waits round up to the timer resolution,
+// 15.625 ms like a stock Windows install until timeBeginPeriod asks for less.
+
+#include <windows.h>
+
+#include "uartSim.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+#define SHIM_DEFAULT_RESOLUTION_MS 15.625
+
+struct ShimEvent {
+    bool manualReset;
+    bool signaled;
+};
+
+static std::mutex eventMutex;
+static std::condition_variable eventCond;
+
+static thread_local DWORD lastError = 0;
+
+static std::mutex timerMutex;
+static int timerRequests = 0;
+static UINT timerPeriodMs = 0;
+
+static std::mutex uartMutex;
+static std::string received;
+static double uartBaud = 0.0;
+
+static double timerResolutionMs() {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    return timerRequests > 0 ? timerPeriodMs : SHIM_DEFAULT_RESOLUTION_MS;
+}
+
+// Index of the first signaled handle, consuming it if it resets automatically. eventMutex held.
+static DWORD takeSignaled(DWORD count, const HANDLE* handles) {
+    for (DWORD i = 0; i < count; ++i) {
+        ShimEvent* event = (ShimEvent*)handles[i];
+        if (event->signaled) {
+            if (!event->manualReset) {
+                event->signaled = false;
+            }
+            return WAIT_OBJECT_0 + i;
+        }
+    }
+    return WAIT_TIMEOUT;
+}
+
+HANDLE CreateEventA(void*, BOOL manualReset, BOOL initialState, const char*) {
+    return new ShimEvent{manualReset != FALSE, initialState != FALSE};
+}
+
+BOOL SetEvent(HANDLE event) {
+    {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        ((ShimEvent*)event)->signaled = true;
+    }
+    eventCond.notify_all();
+    return TRUE;
+}
+
+BOOL ResetEvent(HANDLE event) {
+    std::lock_guard<std::mutex> lock(eventMutex);
+    ((ShimEvent*)event)->signaled = false;
+    return TRUE;
+}
+
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL, DWORD timeoutMs) {
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (timeoutMs != INFINITE) {
+        double resolution = timerResolutionMs();
+        double rounded = std::ceil(timeoutMs / resolution) * resolution;
+        deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((int64_t)(rounded * 1000.0));
+    }
+
+    std::unique_lock<std::mutex> lock(eventMutex);
+    DWORD result;
+    while ((result = takeSignaled(count, handles)) == WAIT_TIMEOUT) {
+        if (eventCond.wait_until(lock, deadline) == std::cv_status::timeout) {
+            return takeSignaled(count, handles);
+        }
+    }
+    return result;
+}
+
+DWORD WaitForSingleObject(HANDLE handle, DWORD timeoutMs) {
+    return WaitForMultipleObjects(1, &handle, FALSE, timeoutMs);
+}
+
+HANDLE CreateThread(void*, size_t, LPTHREAD_START_ROUTINE start, LPVOID parameter, DWORD, DWORD*) {
+    // The thread handle is an event signaled on exit, which is all WaitForSingleObject needs
+    HANDLE done = CreateEventA(NULL, TRUE, FALSE, NULL);
+    std::thread([=] {
+        start(parameter);
+        SetEvent(done);
+    }).detach();
+    return done;
+}
+
+BOOL CloseHandle(HANDLE) {
+    // Events may still be referenced by a detached thread or a write completing, leak them
+    return TRUE;
+}
+
+void InitializeCriticalSection(CRITICAL_SECTION* section) {
+    section->mutex = new std::mutex;
+}
+
+void DeleteCriticalSection(CRITICAL_SECTION* section) {
+    delete (std::mutex*)section->mutex;
+}
+
+void EnterCriticalSection(CRITICAL_SECTION* section) {
+    ((std::mutex*)section->mutex)->lock();
+}
+
+void LeaveCriticalSection(CRITICAL_SECTION* section) {
+    ((std::mutex*)section->mutex)->unlock();
+}
+
+LONG InterlockedExchange(volatile LONG* target, LONG value) {
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+DWORD GetLastError(void) {
+    return lastError;
+}
+
+void Sleep(DWORD ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count) {
+    count->QuadPart = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency) {
+    frequency->QuadPart = 1000000000LL;
+    return TRUE;
+}
+
+MMRESULT timeBeginPeriod(UINT periodMs) {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    if (timerRequests++ == 0 || periodMs < timerPeriodMs) {
+        timerPeriodMs = periodMs;
+    }
+    return TIMERR_NOERROR;
+}
+
+MMRESULT timeEndPeriod(UINT) {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    timerRequests--;
+    return TIMERR_NOERROR;
+}
+
+HANDLE GetStdHandle(DWORD) {
+    return NULL;
+}
+
+BOOL GetConsoleMode(HANDLE, DWORD* mode) {
+    *mode = 0;
+    return TRUE;
+}
+
+BOOL SetConsoleMode(HANDLE, DWORD) {
+    return TRUE;
+}
+
+HANDLE CreateFileA(const char*, DWORD, DWORD, void*, DWORD, DWORD, HANDLE) {
+    return (HANDLE)1;
+}
+
+// Nothing is ever received, the receive side is not simulated
+BOOL ReadFile(HANDLE, void*, DWORD, LPDWORD, LPOVERLAPPED) {
+    lastError = ERROR_OPERATION_ABORTED;
+    return FALSE;
+}
+
+BOOL WriteFile(HANDLE, const void* buf, DWORD size, LPDWORD, LPOVERLAPPED ov) {
+    std::string data((const char*)buf, size);
+    double baud;
+    {
+        std::lock_guard<std::mutex> lock(uartMutex);
+        baud = uartBaud;
+    }
+
+    ResetEvent(ov->hEvent);
+    std::thread([=] {
+        std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(size * 10.0 / baud * 1e6)));
+        {
+            std::lock_guard<std::mutex> lock(uartMutex);
+            received += data;
+        }
+        ov->InternalHigh = size;
+        SetEvent(ov->hEvent);
+    }).detach();
+
+    lastError = ERROR_IO_PENDING;
+    return FALSE;
+}
+
+BOOL GetOverlappedResult(HANDLE, LPOVERLAPPED ov, LPDWORD transferred, BOOL wait) {
+    if (wait) {
+        WaitForSingleObject(ov->hEvent, INFINITE);
+    }
+    *transferred = (DWORD)ov->InternalHigh;
+    return TRUE;
+}
+
+// Writes always run to completion, the caller still waits for them
+BOOL CancelIoEx(HANDLE, LPOVERLAPPED) {
+    return TRUE;
+}
+
+BOOL GetCommState(HANDLE, DCB* dcb) {
+    std::lock_guard<std::mutex> lock(uartMutex);
+    dcb->BaudRate = (DWORD)uartBaud;
+    return TRUE;
+}
+
+BOOL SetCommState(HANDLE, DCB* dcb) {
+    std::lock_guard<std::mutex> lock(uartMutex);
+    uartBaud = dcb->BaudRate;
+    return TRUE;
+}
+
+BOOL SetCommTimeouts(HANDLE, COMMTIMEOUTS*) {
+    return TRUE;
+}
+
+BOOL SetCommMask(HANDLE, DWORD) {
+    return FALSE;
+}
+
+BOOL WaitCommEvent(HANDLE, DWORD*, LPOVERLAPPED) {
+    lastError = ERROR_OPERATION_ABORTED;
+    return FALSE;
+}
+
+BOOL ClearCommError(HANDLE, DWORD* errors, COMSTAT* status) {
+    *errors = 0;
+    status->cbInQue = 0;
+    status->cbOutQue = 0;
+    return TRUE;
+}
+
+std::string uartSimReceived() {
+    std::lock_guard<std::mutex> lock(uartMutex);
+    return received;
+}
+
+void uartSimSetBaud(double baud) {
+    std::lock_guard<std::mutex> lock(uartMutex);
+    uartBaud = baud;
+}
+
+int uartSimTimerRequests() {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    return timerRequests;
+}
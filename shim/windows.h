@@ -0,0 +1,134 @@
+/*
+ * Just enough of the Win32 API for serialPort.c and stimulus.c to build on POSIX hosts, see win32.cpp.
+ * Only used by "make serialtest", the plotter itself builds against the real windows.h.
+ */
+
+#ifndef SHIM_WINDOWS_H
+#define SHIM_WINDOWS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void* HANDLE;
+typedef void* LPVOID;
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef unsigned long DWORD;
+typedef DWORD* LPDWORD;
+typedef unsigned int UINT;
+typedef long LONG;
+typedef int64_t LONGLONG;
+typedef UINT MMRESULT;
+
+#define WINAPI
+#define TRUE 1
+#define FALSE 0
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define WAIT_FAILED 0xFFFFFFFF
+#define TIMERR_NOERROR 0
+
+#define STD_OUTPUT_HANDLE ((DWORD)-11)
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 4
+#define FILE_GENERIC_READ 1
+#define FILE_GENERIC_WRITE 2
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_FLAG_OVERLAPPED 0x40000000
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define CE_RXOVER 1
+#define CE_OVERRUN 8
+#define EV_RXCHAR 1
+#define ERROR_OPERATION_ABORTED 995
+#define ERROR_IO_PENDING 997
+#define CTRL_BREAK_EVENT 1
+
+typedef struct {
+    DWORD ReadIntervalTimeout;
+    DWORD ReadTotalTimeoutMultiplier;
+    DWORD ReadTotalTimeoutConstant;
+    DWORD WriteTotalTimeoutMultiplier;
+    DWORD WriteTotalTimeoutConstant;
+} COMMTIMEOUTS;
+
+typedef struct {
+    DWORD DCBlength;
+    DWORD BaudRate;
+} DCB;
+
+typedef struct {
+    DWORD cbInQue;
+    DWORD cbOutQue;
+} COMSTAT;
+
+typedef struct {
+    uintptr_t Internal;
+    uintptr_t InternalHigh;
+    DWORD Offset;
+    DWORD OffsetHigh;
+    HANDLE hEvent;
+} OVERLAPPED, *LPOVERLAPPED;
+
+typedef struct {
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct {
+    void* mutex;
+} CRITICAL_SECTION;
+
+typedef DWORD (*LPTHREAD_START_ROUTINE)(LPVOID);
+
+/* Events, threads and locks */
+HANDLE CreateEventA(void* attributes, BOOL manualReset, BOOL initialState, const char* name);
+#define CreateEvent CreateEventA
+BOOL SetEvent(HANDLE event);
+BOOL ResetEvent(HANDLE event);
+DWORD WaitForSingleObject(HANDLE handle, DWORD timeoutMs);
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL waitAll, DWORD timeoutMs);
+HANDLE CreateThread(void* attributes, size_t stackSize, LPTHREAD_START_ROUTINE start, LPVOID parameter, DWORD flags, DWORD* id);
+BOOL CloseHandle(HANDLE handle);
+void InitializeCriticalSection(CRITICAL_SECTION* section);
+void DeleteCriticalSection(CRITICAL_SECTION* section);
+void EnterCriticalSection(CRITICAL_SECTION* section);
+void LeaveCriticalSection(CRITICAL_SECTION* section);
+LONG InterlockedExchange(volatile LONG* target, LONG value);
+DWORD GetLastError(void);
+void Sleep(DWORD ms);
+
+/* Clocks, timeouts round up to the timer resolution like they do on Windows */
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+MMRESULT timeBeginPeriod(UINT periodMs);
+MMRESULT timeEndPeriod(UINT periodMs);
+
+/* Console */
+HANDLE GetStdHandle(DWORD which);
+BOOL GetConsoleMode(HANDLE console, DWORD* mode);
+BOOL SetConsoleMode(HANDLE console, DWORD mode);
+
+/* Files and the simulated UART behind them */
+HANDLE CreateFileA(const char* name, DWORD access, DWORD share, void* security, DWORD disposition, DWORD flags, HANDLE templateFile);
+BOOL ReadFile(HANDLE file, void* buf, DWORD size, LPDWORD read, LPOVERLAPPED ov);
+BOOL WriteFile(HANDLE file, const void* buf, DWORD size, LPDWORD written, LPOVERLAPPED ov);
+BOOL GetOverlappedResult(HANDLE file, LPOVERLAPPED ov, LPDWORD transferred, BOOL wait);
+BOOL CancelIoEx(HANDLE file, LPOVERLAPPED ov);
+BOOL GetCommState(HANDLE file, DCB* dcb);
+BOOL SetCommState(HANDLE file, DCB* dcb);
+BOOL SetCommTimeouts(HANDLE file, COMMTIMEOUTS* timeouts);
+BOOL SetCommMask(HANDLE file, DWORD mask);
+BOOL WaitCommEvent(HANDLE file, DWORD* mask, LPOVERLAPPED ov);
+BOOL ClearCommError(HANDLE file, DWORD* errors, COMSTAT* status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHIM_WINDOWS_H */
@@ -0,0 +1,127 @@
+#include "stimulus.h"
+
+#include <math.h>
+#include <string.h>
+
+
+/* Longest line a sample can turn into */
+#define STIMULUS_LINE_MAX 24
+
+#define STIMULUS_TWO_PI 6.283185307179586
+
+
+void stimulusWaveInit(stimulus_wave_t *wave, stimulus_shape_t shape, double frequency, double amplitude, double offset, double sampleRate)
+{
+    wave->shape = shape;
+    wave->frequency = frequency;
+    wave->amplitude = amplitude;
+    wave->offset = offset;
+    wave->sampleRate = sampleRate;
+    wave->sample = 0;
+}
+
+
+int stimulusShapeFromName(const char *name, stimulus_shape_t *shape)
+{
+    static const char *names[] = { "sine", "square", "triangle", "saw" };
+
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            *shape = (stimulus_shape_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+double stimulusWaveValue(const stimulus_wave_t *wave, uint64_t sample)
+{
+    /* position within the period in [0, 1) */
+    double cycles = (double)sample * wave->frequency / wave->sampleRate;
+    double phase = cycles - floor(cycles);
+    double unit;
+
+    switch (wave->shape)
+    {
+    case STIMULUS_SQUARE:
+        unit = phase < 0.5 ? 1.0 : -1.0;
+        break;
+    case STIMULUS_TRIANGLE:
+        unit = 4.0 * fabs(phase - 0.5) - 1.0;
+        break;
+    case STIMULUS_SAW:
+        unit = 2.0 * phase - 1.0;
+        break;
+    default:
+        unit = sin(STIMULUS_TWO_PI * phase);
+        break;
+    }
+
+    return wave->offset + wave->amplitude * unit;
+}
+
+
+int stimulusWaveSource(void *context, uint8_t *buf, uint32_t size, double until)
+{
+    stimulus_wave_t *wave = (stimulus_wave_t*)context;
+    uint32_t written = 0;
+
+    /* whole lines only, a sample that doesn't fit waits for the next call */
+    while ((double)wave->sample < until * wave->sampleRate && size - written >= STIMULUS_LINE_MAX)
+    {
+        written += snprintf((char*)buf + written, STIMULUS_LINE_MAX, "%ld\n", lround(stimulusWaveValue(wave, wave->sample)));
+        wave->sample++;
+    }
+
+    return (int)written;
+}
+
+
+int stimulusFileOpen(stimulus_file_t *stim, const char *path, double bytesPerSecond, int loop)
+{
+    stim->file = fopen(path, "rb");
+    stim->bytesPerSecond = bytesPerSecond;
+    stim->produced = 0;
+    stim->loop = loop;
+
+    return stim->file ? 0 : -1;
+}
+
+
+void stimulusFileClose(stimulus_file_t *stim)
+{
+    if (stim->file)
+        fclose(stim->file);
+    stim->file = NULL;
+}
+
+
+int stimulusFileSource(void *context, uint8_t *buf, uint32_t size, double until)
+{
+    stimulus_file_t *stim = (stimulus_file_t*)context;
+
+    double due = until * stim->bytesPerSecond - (double)stim->produced;
+    if (due < 1.0)
+        return 0;
+
+    uint32_t n = due < (double)size ? (uint32_t)due : size;
+    size_t got = fread(buf, 1, n, stim->file);
+
+    if (got == 0)
+    {
+        if (!stim->loop || ferror(stim->file))
+            return -1;
+
+        /* an empty file ends the stream even when looping */
+        rewind(stim->file);
+        got = fread(buf, 1, n, stim->file);
+        if (got == 0)
+            return -1;
+    }
+
+    stim->produced += got;
+    return (int)got;
+}
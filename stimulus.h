@@ -0,0 +1,110 @@
+/**
+ * @file stimulus.h
+ * @brief Stimulus sources for serialTxStream.
+ *
+ * A stimulus is either a file streamed at a fixed byte rate or a generated waveform sent as
+ * one ASCII integer per line at a fixed sample rate. Both implement serial_tx_source_t and
+ * are called from the transmit thread only.
+ */
+
+#ifndef STIMULUS_H
+#define STIMULUS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @enum stimulus_shape_t
+ * @brief Waveform shapes of the generator.
+ *
+ * @ingroup enums
+ */
+typedef enum {
+    STIMULUS_SINE,
+    STIMULUS_SQUARE,
+    STIMULUS_TRIANGLE,
+    STIMULUS_SAW
+} stimulus_shape_t;
+
+/**
+ * @struct stimulus_wave_t
+ * @brief Waveform generator state.
+ *
+ * @ingroup structs
+ */
+typedef struct {
+    stimulus_shape_t shape;     /**< Shape of one period. */
+    double frequency;           /**< Periods per second. */
+    double amplitude;           /**< Peak deviation from the offset. */
+    double offset;              /**< Value the waveform swings around. */
+    double sampleRate;          /**< Lines sent per second. */
+    uint64_t sample;            /**< Index of the next sample. */
+} stimulus_wave_t;
+
+/**
+ * @struct stimulus_file_t
+ * @brief File streaming state.
+ *
+ * @ingroup structs
+ */
+typedef struct {
+    FILE *file;                 /**< Open stimulus file. */
+    double bytesPerSecond;      /**< Pace of the stream. */
+    uint64_t produced;          /**< Bytes handed out so far. */
+    int loop;                   /**< Start over at the end of the file instead of ending the stream. */
+} stimulus_file_t;
+
+/**
+ * @brief Initialises a waveform generator at sample 0.
+ *
+ * @ingroup HL_functions
+ */
+void stimulusWaveInit(stimulus_wave_t *wave, stimulus_shape_t shape, double frequency, double amplitude, double offset, double sampleRate);
+
+/**
+ * @brief Parses a shape name (sine, square, triangle or saw).
+ *
+ * @return 0 if successful, -1 if the name is unknown.
+ *
+ * @ingroup HL_functions
+ */
+int stimulusShapeFromName(const char *name, stimulus_shape_t *shape);
+
+/**
+ * @brief Value of the waveform at a sample index.
+ *
+ * @ingroup HL_functions
+ */
+double stimulusWaveValue(const stimulus_wave_t *wave, uint64_t sample);
+
+/**
+ * @brief serial_tx_source_t producing one "%d\n" line per sample due.
+ *
+ * @ingroup HL_functions
+ */
+int stimulusWaveSource(void *context, uint8_t *buf, uint32_t size, double until);
+
+/**
+ * @brief Opens a file for streaming.
+ *
+ * @return 0 if successful, -1 if the file could not be opened.
+ *
+ * @ingroup HL_functions
+ */
+int stimulusFileOpen(stimulus_file_t *stim, const char *path, double bytesPerSecond, int loop);
+
+/**
+ * @brief Closes the file. The stream must be stopped first.
+ *
+ * @ingroup HL_functions
+ */
+void stimulusFileClose(stimulus_file_t *stim);
+
+/**
+ * @brief serial_tx_source_t producing the file's bytes at bytesPerSecond.
+ *
+ * @ingroup HL_functions
+ */
+int stimulusFileSource(void *context, uint8_t *buf, uint32_t size, double until);
+
+#endif
@@ -0,0 +1,159 @@
+#include "trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+enum TraceType : uint8_t { TRACE_SPAN, TRACE_VALUE };
+
+struct TraceEvent {
+    uint64_t time;          // ns, span start or counter sample time
+    int64_t value;          // span duration in ns or counter value
+    const char* name;
+    uint8_t type;
+};
+
+// Single producer ring, the dump reads it without stopping the owner
+struct TraceBuffer {
+    std::atomic<uint64_t> head;
+    std::atomic<const char*> threadName;
+    uint32_t tid;
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+std::atomic<bool> traceRecording(false);
+
+static const auto traceEpoch = std::chrono::steady_clock::now();
+
+// Buffers are never freed, so events of exited threads still show up in a dump
+static std::mutex registryMutex;
+static std::vector<TraceBuffer*> registry;
+static std::atomic<int> dumpCounter(0);
+
+static thread_local TraceBuffer* threadBuffer = nullptr;
+static thread_local const char* threadLabel = nullptr;
+
+static TraceBuffer* localBuffer() {
+    if (!threadBuffer) {
+        TraceBuffer* buffer = new TraceBuffer();
+        buffer->head = 0;
+        buffer->threadName = threadLabel;
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffer->tid = (uint32_t)registry.size() + 1;
+        registry.push_back(buffer);
+        threadBuffer = buffer;
+    }
+    return threadBuffer;
+}
+
+static void record(const char* name, uint8_t type, uint64_t time, int64_t value) {
+    TraceBuffer* buffer = localBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    TraceEvent& event = buffer->events[head % TRACE_BUFFER_EVENTS];
+    event.time = time;
+    event.value = value;
+    event.name = name;
+    event.type = type;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+int traceIsActive(void) {
+    return traceActive();
+}
+
+void traceEnable(int enable) {
+    traceRecording.store(enable != 0, std::memory_order_relaxed);
+}
+
+uint64_t traceNow(void) {
+    // Offset by one so that a valid timestamp is never zero, TRACE_END relies on that
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceEpoch).count() + 1;
+}
+
+void traceComplete(const char* name, uint64_t start) {
+    uint64_t end = traceNow();
+    record(name, TRACE_SPAN, start, (int64_t)(end - start));
+}
+
+void traceCounter(const char* name, int64_t value) {
+    record(name, TRACE_VALUE, traceNow(), value);
+}
+
+void traceSetThreadName(const char* name) {
+    // Threads that never record don't get a buffer, the label is applied once they do
+    threadLabel = name;
+    if (threadBuffer) {
+        threadBuffer->threadName.store(name, std::memory_order_relaxed);
+    }
+}
+
+int traceDump(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+
+    std::vector<TraceBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffers = registry;
+    }
+
+    int written = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (TraceBuffer* buffer : buffers) {
+        const char* threadName = buffer->threadName.load(std::memory_order_relaxed);
+        if (threadName) {
+            fprintf(file, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                    written ? ",\n" : "", buffer->tid, threadName);
+            written++;
+        }
+
+        // The owner keeps recording meanwhile, so only the oldest events can be torn
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+        for (uint64_t i = first; i < head; ++i) {
+            const TraceEvent& event = buffer->events[i % TRACE_BUFFER_EVENTS];
+            if (event.type == TRACE_SPAN) {
+                fprintf(file, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"name\":\"%s\",\"ts\":%.3f,\"dur\":%.3f}",
+                        written ? ",\n" : "", buffer->tid, event.name, event.time / 1000.0, event.value / 1000.0);
+            } else {
+                fprintf(file, "%s{\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"name\":\"%s\",\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                        written ? ",\n" : "", buffer->tid, event.name, event.time / 1000.0, (long long)event.value);
+            }
+            written++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0) {
+        return -1;
+    }
+    return written;
+}
+
+int traceDumpNext(void) {
+    char path[64];
+
+    // Skip names taken by earlier sessions instead of overwriting their dumps
+    for (;;) {
+        snprintf(path, sizeof(path), "trace-%d.json", dumpCounter.fetch_add(1));
+        FILE* existing = fopen(path, "r");
+        if (!existing) {
+            break;
+        }
+        fclose(existing);
+    }
+
+    int events = traceDump(path);
+    if (events < 0) {
+        printf("Trace dump to %s failed\n", path);
+    } else {
+        printf("Wrote %d trace events to %s\n", events, path);
+    }
+    return events;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file trace.h
+ * @brief Low overhead tracing of the ingest and render stages.
+ *
+ * Spans and counters are recorded into per-thread ring buffers with nanosecond timestamps
+ * and can be dumped at any time as Chrome trace event JSON, which chrome://tracing and
+ * Perfetto open directly. Recording is off by default; while off every probe costs one
+ * relaxed load and a branch. Defining TRACE_DISABLED compiles the probes out entirely.
+ *
+ * The C functions can be used from serialPort.c, C++ code uses TRACE_SCOPE and TRACE_COUNTER.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Events kept per thread, older ones are overwritten */
+#define TRACE_BUFFER_EVENTS 32768
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int traceIsActive(void);
+void traceEnable(int enable);
+
+uint64_t traceNow(void);
+
+/* Record a span named name that started at start (from traceNow) and ends now */
+void traceComplete(const char* name, uint64_t start);
+
+/* Record the current value of a counter */
+void traceCounter(const char* name, int64_t value);
+
+/* Label the calling thread in the dump */
+void traceSetThreadName(const char* name);
+
+/* Write every buffered event to path, returns the number of events or -1 on error */
+int traceDump(const char* path);
+
+/* Dump to the first trace-N.json in the working directory that does not exist yet, earlier sessions' dumps are kept */
+int traceDumpNext(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef TRACE_DISABLED
+#define TRACE_BEGIN() ((uint64_t)0)
+#define TRACE_END(name, start) do { (void)(start); } while (0)
+#else
+#define TRACE_BEGIN() (traceIsActive() ? traceNow() : (uint64_t)0)
+#define TRACE_END(name, start) do { if (start) traceComplete(name, start); } while (0)
+#endif
+
+#ifdef __cplusplus
+
+#include <atomic>
+
+extern std::atomic<bool> traceRecording;
+
+inline bool traceActive() {
+    return traceRecording.load(std::memory_order_relaxed);
+}
+
+// Records a span from construction to destruction
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name_(name), start_(traceActive() ? traceNow() : 0) {}
+    ~TraceScope() {
+        if (start_) {
+            traceComplete(name_, start_);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    uint64_t start_;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+
+#ifdef TRACE_DISABLED
+#define TRACE_SCOPE(name)
+#define TRACE_COUNTER(name, value)
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_COUNTER(name, value) do { if (traceActive()) traceCounter(name, (int64_t)(value)); } while (0)
+#endif
+
+#endif /* __cplusplus */
+
+#endif /* TRACE_H */
@@ -0,0 +1,88 @@
+#include "workerPool.h"
+#include "trace.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(size_t threads)
+    : slices_(new Slice[threads + 1]), task_(nullptr), generation_(0), active_(0), stop_(false) {
+    for (size_t i = 0; i <= threads; ++i) {
+        slices_[i].next = 0;
+        slices_[i].end = 0;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back(&WorkerPool::workerLoop, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void WorkerPool::drain(size_t self, const std::function<void(size_t)>& task) {
+    size_t participants = size();
+
+    // Own slice first, then walk the others and steal whatever is left
+    for (size_t k = 0; k < participants; ++k) {
+        Slice& slice = slices_[(self + k) % participants];
+        for (;;) {
+            size_t i = slice.next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= slice.end) {
+                break;
+            }
+            task(i);
+        }
+    }
+}
+
+void WorkerPool::workerLoop(size_t self) {
+    uint64_t seen = 0;
+    traceSetThreadName("pool worker");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_) {
+            return;
+        }
+        seen = generation_;
+        const std::function<void(size_t)>* task = task_;
+        active_++;
+        lock.unlock();
+
+        drain(self, *task);
+
+        lock.lock();
+        if (--active_ == 0) {
+            done_.notify_all();
+        }
+    }
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+    size_t participants = size();
+    {
+        // A worker that woke up late may still be walking the previous slices
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return active_ == 0; });
+
+        for (size_t i = 0; i < participants; ++i) {
+            slices_[i].next.store(count * i / participants, std::memory_order_relaxed);
+            slices_[i].end = count * (i + 1) / participants;
+        }
+        task_ = &task;
+        generation_++;
+    }
+    wake_.notify_all();
+
+    drain(participants - 1, task);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&] { return active_ == 0; });
+}
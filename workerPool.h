@@ -0,0 +1,53 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that run index ranges in parallel.
+// Every participant gets a slice of the range and steals from the others once its own
+// slice is exhausted, so uneven per-index cost (e.g. channels with different windows) balances out.
+class WorkerPool {
+public:
+    // threads is the number of helpers, the thread calling parallelFor always joins in
+    explicit WorkerPool(size_t threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Runs task(i) for every i in [0, count) and returns once all of them are done.
+    // Only one thread may call this at a time.
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+    size_t size() const { return threads_.size() + 1; }
+
+private:
+    struct alignas(64) Slice {
+        std::atomic<size_t> next;
+        size_t end;
+    };
+
+    void workerLoop(size_t self);
+    void drain(size_t self, const std::function<void(size_t)>& task);
+
+    std::vector<std::thread> threads_;
+    std::unique_ptr<Slice[]> slices_;   // one per participant, the caller owns the last one
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(size_t)>* task_;
+    uint64_t generation_;
+    size_t active_;                     // workers currently draining
+    bool stop_;
+};
+
+#endif // WORKERPOOL_H